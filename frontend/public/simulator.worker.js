@@ -0,0 +1,217 @@
+// Hosts the WebAssembly simulator outside of the UI thread. The protocol is implemented by src/chasimulator.ts:
+// calls are answered in the order they arrive, the attacker and router state is published to a SharedArrayBuffer ring.
+// Every message addresses a simulator instance by its handle, messages without one go to the displayed instance.
+
+// Layout of the state ring, keep in sync with src/chasimulator.ts
+const RING_SEQUENCE = 0, RING_STOP = 1, RING_SLOTS = 2, RING_ROUTER_WORDS = 3, RING_HEADER_SIZE = 4;
+const SLOT_SEQUENCE = 0, SLOT_TICK = 1, SLOT_DONE = 2, SLOT_ATTACKER_V1 = 3, SLOT_ATTACKER_V2 = 4,
+    SLOT_ATTACKER_FRACTION = 5, SLOT_ATTACKER_X = 6, SLOT_ATTACKER_Y = 7, SLOT_HEADER_SIZE = 8;
+
+// Layout of the frame returned by do_ticks, see frame_field_t in chasimulator.cpp
+const FRAME_TICKS = 0, FRAME_TICK = 1, FRAME_DONE = 2, FRAME_ATTACKER_V1 = 3, FRAME_ATTACKER_V2 = 4,
+    FRAME_ATTACKER_FRACTION = 5, FRAME_ATTACKER_X = 6, FRAME_ATTACKER_Y = 7, FRAME_EVENT_COUNT = 8,
+    FRAME_ROUTER_COUNT = 9, FRAME_HEADER_SIZE = 10, FRAME_EVENT_SIZE = 5;
+
+// Encoding of run_batch, see batch_strategy_t and batch_metric_t in chasimulator.cpp
+const BATCH_STRATEGY_SIZE = 4, BATCH_METRIC_COUNT = 4;
+
+// Matches the EventType enum of src/types.ts
+const EVENT_ROUTER_DETECTS = 0, EVENT_ROUTER_MISSES = 1;
+
+let ready = false;
+const queue = [];
+let displayed = -1; // Handle of the instance whose state is published to the ring
+
+let ringI32 = undefined, ringF32 = undefined;
+let active = new Uint32Array(0); // Router state of the last published slot
+
+self.onmessage = e => {
+    queue.push(e.data);
+    if (ready && queue.length === 1) drain();
+};
+
+self.Module = {
+    onRuntimeInitialized() {
+        displayed = Module.ccall("sim_create", "number");
+        ready = true;
+        drain();
+    }
+};
+importScripts("chasimulator.js");
+
+async function drain() {
+    while (queue.length) {
+        const message = queue[0];
+        try {
+            postMessage({type: "result", id: message.id, result: await handle(message)});
+        } catch (e) {
+            postMessage({type: "error", id: message.id, error: `${e}`});
+        }
+        queue.shift();
+    }
+}
+
+async function handle(message) {
+    const sim = message.handle ?? displayed;
+    switch (message.type) {
+        case "create":
+            return message.seed === undefined ? Module.ccall("sim_create", "number") :
+                Module.ccall("sim_create_shared", "number", ["number", "number"], [message.scenario ?? displayed, message.seed]);
+        case "destroy":
+            if (message.handle === displayed) throw new Error("The displayed instance cannot be destroyed");
+            Module.ccall("sim_destroy", undefined, ["number"], [message.handle]);
+            return undefined;
+        case "call": {
+            const result = Module.ccall(message.func, message.returnType, ["number", ...(message.argTypes ?? [])],
+                [sim, ...(message.args ?? [])]);
+            if (sim === displayed &&
+                (message.func === "set_attacker" || message.func === "reset" || message.func === "full_reset")) {
+                syncRouters();
+                publish(readFrame(doTicks(sim, 0)));
+            }
+            return result;
+        }
+        case "bulk": {
+            const data = message.data;
+            const ptr = Module._malloc(data.length * data.BYTES_PER_ELEMENT);
+            (data instanceof Float32Array ? Module.HEAPF32 : Module.HEAP32).set(data, ptr >> 2);
+            Module.ccall(message.func, undefined, ["number", "number", "number"], [sim, ptr, data.length / 2]);
+            Module._free(ptr);
+            return undefined;
+        }
+        case "ring":
+            ringI32 = new Int32Array(message.ring);
+            ringF32 = new Float32Array(message.ring);
+            active = new Uint32Array(ringI32[RING_ROUTER_WORDS]);
+            syncRouters();
+            return undefined;
+        case "do_ticks": {
+            const frame = readFrame(doTicks(sim, message.n));
+            if (sim === displayed) publish(frame);
+            return frame;
+        }
+        case "run_batch": {
+            const strategies = message.strategies;
+            const ptr = Module._malloc(strategies.length * strategies.BYTES_PER_ELEMENT);
+            Module.HEAPF32.set(strategies, ptr >> 2);
+            const results = Module.ccall("run_batch", "number",
+                ["number", "number", "number", "number", "boolean", "number"],
+                [sim, ptr, strategies.length / BATCH_STRATEGY_SIZE, message.runs, message.replaceAttacker, message.minPathLength]);
+            Module._free(ptr);
+            const count = strategies.length / BATCH_STRATEGY_SIZE * BATCH_METRIC_COUNT * message.runs;
+            const metrics = Module.HEAPF32.slice(results >> 2, (results >> 2) + count);
+            if (sim === displayed) {
+                syncRouters(); // The attacker of the simulator might have been replaced
+                publish(readFrame(doTicks(sim, 0)));
+            }
+            return metrics;
+        }
+        case "sample_router_layout": {
+            const layout = Module.ccall("sample_router_layout", "number", ["number", "number", "number"],
+                [sim, message.n, message.radius]);
+            return Module.HEAPF32.slice(layout >> 2, (layout >> 2) + 3 * message.n);
+        }
+        case "run_parallel": {
+            const handles = Int32Array.from(message.handles);
+            const ptr = Module._malloc(handles.length * handles.BYTES_PER_ELEMENT);
+            Module.HEAP32.set(handles, ptr >> 2);
+            Module.ccall("sim_run_parallel", undefined, ["number", "number"], [ptr, handles.length]);
+            Module._free(ptr);
+            if (message.handles.includes(displayed)) {
+                syncRouters();
+                publish(readFrame(doTicks(displayed, 0)));
+            }
+            return undefined;
+        }
+        case "simulate":
+            return simulate(sim, message.count, message.delay, message.batch, message.log);
+    }
+    throw new Error(`Unknown message type ${message.type}`);
+}
+
+function doTicks(sim, n) {
+    return Module.ccall("do_ticks", "number", ["number", "number"], [sim, n]);
+}
+
+async function simulate(sim, count, delay, batch, log) {
+    const infinite = count < 0;
+    let ticks = 0;
+    if (ringI32) Atomics.store(ringI32, RING_STOP, 0);
+
+    while ((infinite || ticks < count) && !(ringI32 && Atomics.load(ringI32, RING_STOP)) &&
+           !Module.ccall("is_done", "boolean", ["number"], [sim])) {
+        const frame = readFrame(doTicks(sim, infinite ? batch : Math.min(batch, count - ticks)));
+        if (!frame.ticks) break;
+        ticks += frame.ticks;
+        if (sim === displayed) publish(frame);
+        if (log) postMessage({type: "frame", frame});
+        if (delay) await new Promise(r => setTimeout(r, delay));
+    }
+    return {ticks, done: Module.ccall("is_done", "boolean", ["number"], [sim])};
+}
+
+function readFrame(ptr) {
+    const i32 = Module.HEAP32, f32 = Module.HEAPF32;
+    ptr >>= 2;
+    const frame = {
+        ticks: i32[ptr + FRAME_TICKS],
+        tick: i32[ptr + FRAME_TICK],
+        done: i32[ptr + FRAME_DONE] !== 0,
+        attacker: {
+            edge: [i32[ptr + FRAME_ATTACKER_V1], i32[ptr + FRAME_ATTACKER_V2]],
+            fraction: f32[ptr + FRAME_ATTACKER_FRACTION],
+            position: [f32[ptr + FRAME_ATTACKER_X], f32[ptr + FRAME_ATTACKER_Y]]
+        },
+        events: [],
+        routers: []
+    };
+    let offset = ptr + FRAME_HEADER_SIZE;
+    for (let i = 0; i < i32[ptr + FRAME_EVENT_COUNT]; i++, offset += FRAME_EVENT_SIZE) {
+        frame.events.push({
+            // The event types of the library are router_detects = 0 and router_misses = 1
+            type: i32[offset] === 0 ? EVENT_ROUTER_DETECTS : EVENT_ROUTER_MISSES,
+            tick: i32[offset + 1],
+            router: i32[offset + 2],
+            position: [f32[offset + 3], f32[offset + 4]]
+        });
+    }
+    for (let i = 0; i < i32[ptr + FRAME_ROUTER_COUNT]; i++, offset++) {
+        const index = i32[offset] >> 1;
+        frame.routers.push({index, active: (i32[offset] & 1) !== 0});
+        if (index < 32 * active.length) {
+            if (i32[offset] & 1) active[index >> 5] |= 1 << (index & 31);
+            else active[index >> 5] &= ~(1 << (index & 31));
+        }
+    }
+    return frame;
+}
+
+function syncRouters() {
+    active.fill(0);
+    const count = Math.min(Module.ccall("count_routers", "number", ["number"], [displayed]), 32 * active.length);
+    for (let i = 0; i < count; i++) {
+        if (Module.ccall("get_router_active_by_index", "number", ["number", "number"], [displayed, i])) {
+            active[i >> 5] |= 1 << (i & 31);
+        }
+    }
+}
+
+function publish(frame) {
+    if (!ringI32) return;
+    const sequence = ringI32[RING_SEQUENCE] + 1;
+    const slotSize = SLOT_HEADER_SIZE + ringI32[RING_ROUTER_WORDS];
+    const slot = RING_HEADER_SIZE + (sequence % ringI32[RING_SLOTS]) * slotSize;
+
+    // The slot sequence is invalidated while writing, so readers can detect torn slots
+    Atomics.store(ringI32, slot + SLOT_SEQUENCE, -1);
+    ringI32[slot + SLOT_TICK] = frame.tick;
+    ringI32[slot + SLOT_DONE] = frame.done ? 1 : 0;
+    ringI32[slot + SLOT_ATTACKER_V1] = frame.attacker.edge[0];
+    ringI32[slot + SLOT_ATTACKER_V2] = frame.attacker.edge[1];
+    ringF32[slot + SLOT_ATTACKER_FRACTION] = frame.attacker.fraction;
+    ringF32[slot + SLOT_ATTACKER_X] = frame.attacker.position[0];
+    ringF32[slot + SLOT_ATTACKER_Y] = frame.attacker.position[1];
+    ringI32.set(active, slot + SLOT_HEADER_SIZE);
+    Atomics.store(ringI32, slot + SLOT_SEQUENCE, sequence);
+    Atomics.store(ringI32, RING_SEQUENCE, sequence);
+}
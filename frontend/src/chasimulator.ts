@@ -1,8 +1,72 @@
-declare const Module: {
-    ccall(func: string, returnType?: string, argumentTypes?: string[], arguments?: any[]): any;
-    cwrap(func: string, returnType?: string, argumentTypes?: string[]): (...args: any) => any;
+import type {TickFrame} from "@/types";
+
+// The simulator runs in public/simulator.worker.js. Every call is forwarded to the worker, which answers them in order,
+// so calls without a result do not need to be awaited. The attacker and router state is additionally published to a
+// SharedArrayBuffer ring, which the UI samples at its own frame rate.
+// The methods address the displayed simulator instance, further instances are created with create_instance or
+// fork_instance and addressed by their handle through call_instance.
+
+// Layout of the state ring, keep in sync with public/simulator.worker.js
+const enum Ring {
+    Sequence, Stop, Slots, RouterWords, HeaderSize
+}
+const enum Slot {
+    Sequence, Tick, Done, AttackerV1, AttackerV2, AttackerFraction, AttackerX, AttackerY, HeaderSize
+}
+const ringSlots = 8;
+
+// Encoding of run_batch, see batch_strategy_t and batch_metric_t in chasimulator.cpp
+export const enum BatchStrategy {
+    Sample, SlidingWindow, KSmartestNeighbors, Size = 4
+}
+export const enum BatchMetric {
+    Activity, Detection, LastTracking, Path, Count
+}
+
+export type StateSample = {
+    tick: number;
+    done: boolean;
+    attacker: {
+        edge: [number, number];
+        fraction: number;
+        position: [number, number];
+    };
+    active: Int32Array; // Router active bitset, router i is bit i % 32 of word i / 32
 };
 
+const worker = new Worker("simulator.worker.js");
+const pending = new Map<number, { resolve: (result: any) => void, reject: (error: any) => void }>();
+let nextId = 0;
+let frameListener: ((frame: TickFrame) => void) | undefined;
+
+let ring = new SharedArrayBuffer(4 * Ring.HeaderSize);
+let ringI32 = new Int32Array(ring), ringF32 = new Float32Array(ring);
+let lastSequence = 0;
+
+worker.onmessage = e => {
+    const message = e.data;
+    if (message.type == "frame") {
+        frameListener?.(message.frame);
+        return;
+    }
+    const request = pending.get(message.id);
+    pending.delete(message.id);
+    if (message.type == "result") request?.resolve(message.result);
+    else request?.reject(message.error);
+};
+
+function post(message: object): Promise<any> {
+    const id = nextId++;
+    return new Promise((resolve, reject) => {
+        pending.set(id, {resolve, reject});
+        worker.postMessage({...message, id});
+    });
+}
+
+function call(func: string, returnType?: string, argTypes?: string[], args?: any[], handle?: number): Promise<any> {
+    return post({type: "call", func, returnType, argTypes, args, handle});
+}
+
 const debug = false;
 if (debug) {
     const textarea = document.createElement("textarea");
@@ -12,190 +76,285 @@ if (debug) {
 }
 
 export default {
-    add_vertex(vertex: number, x: number, y: number): void {
+    add_vertex(vertex: number, x: number, y: number): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `add_vertex(${vertex}, ${x}, ${y});\n`;
         }
-        Module.ccall("add_vertex", undefined, ["number", "number", "number"], [vertex, x, y]);
+        return call("add_vertex", undefined, ["number", "number", "number"], [vertex, x, y]);
     },
-    add_edge(v1: number, v2: number): void {
+    add_edge(v1: number, v2: number): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `add_edge(${v1}, ${v2});\n`;
         }
-        Module.ccall("add_edge", undefined, ["number", "number"], [v1, v2]);
+        return call("add_edge", undefined, ["number", "number"], [v1, v2]);
+    },
+    add_vertices_bulk(xy: Float32Array): Promise<void> {
+        // xy holds the coordinates of the vertices 0..n-1 as [x0, y0, x1, y1, ...]
+        return post({type: "bulk", func: "add_vertices_bulk", data: xy});
     },
-    build_graph(): void {
+    add_edges_bulk(pairs: Int32Array): Promise<void> {
+        // pairs holds the edges as [v1, v2, v1, v2, ...]
+        return post({type: "bulk", func: "add_edges_bulk", data: pairs});
+    },
+    build_graph(): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `build_graph();\n`;
         }
-        Module.ccall("build_graph");
+        return call("build_graph");
     },
-    set_sample_strategy(distance: number): void {
+    set_sample_strategy(distance: number): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `set_sample_strategy(${distance});\n`;
         }
-        Module.ccall("set_sample_strategy", undefined, ["number"], [distance]);
+        return call("set_sample_strategy", undefined, ["number"], [distance]);
     },
-    set_sliding_window_strategy(distance: number, time: number): void {
+    set_sliding_window_strategy(distance: number, time: number): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `set_sliding_window_strategy(${distance}, ${time});\n`;
         }
-        Module.ccall("set_sliding_window_strategy", undefined, ["number", "number"], [distance, time]);
+        return call("set_sliding_window_strategy", undefined, ["number", "number"], [distance, time]);
     },
-    set_k_smartest_neighbors_strategy(k: number, distance: number, lazy: boolean): void {
+    set_k_smartest_neighbors_strategy(k: number, distance: number, lazy: boolean): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `set_k_smartest_neighbors_strategy(${k}, ${distance}, ${lazy});\n`;
         }
-        Module.ccall("set_k_smartest_neighbors_strategy", undefined, ["number", "number", "boolean"], [k, distance, lazy]);
+        return call("set_k_smartest_neighbors_strategy", undefined, ["number", "number", "boolean"], [k, distance, lazy]);
     },
-    set_attacker(v1: number, v2: number, target: number, fraction: number, speed: number, tx_prob: number, alpha_router_index: number, min_path_length: number): boolean {
+    set_attacker(v1: number, v2: number, target: number, fraction: number, speed: number, tx_prob: number, alpha_router_index: number, min_path_length: number): Promise<boolean> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `set_attacker(${v1}, ${v2}, ${target}, ${fraction}, ${speed}, ${tx_prob}, ${alpha_router_index}, ${min_path_length});\n`;
         }
-        return Module.ccall("set_attacker", "boolean",
+        return call("set_attacker", "boolean",
             ["number", "number", "number", "number", "number", "number", "number", "number"],
             [v1, v2, target, fraction, speed, tx_prob, alpha_router_index, min_path_length]);
     },
-    get_attacker_v1(): number {
-        return Module.ccall("get_attacker_v1", "number");
+    get_attacker_v1(): Promise<number> {
+        return call("get_attacker_v1", "number");
     },
-    get_attacker_v2(): number {
-        return Module.ccall("get_attacker_v2", "number");
+    get_attacker_v2(): Promise<number> {
+        return call("get_attacker_v2", "number");
     },
-    get_attacker_fraction(): number {
-        return Module.ccall("get_attacker_fraction", "number");
+    get_attacker_fraction(): Promise<number> {
+        return call("get_attacker_fraction", "number");
     },
-    get_attacker_x(): number {
-        return Module.ccall("get_attacker_x", "number");
+    get_attacker_x(): Promise<number> {
+        return call("get_attacker_x", "number");
     },
-    get_attacker_y(): number {
-        return Module.ccall("get_attacker_y", "number");
+    get_attacker_y(): Promise<number> {
+        return call("get_attacker_y", "number");
     },
-    get_attacker_speed(): number {
-        return Module.ccall("get_attacker_speed", "number");
+    get_attacker_speed(): Promise<number> {
+        return call("get_attacker_speed", "number");
     },
-    get_attacker_tx_prob(): number {
-        return Module.ccall("get_attacker_tx_prob", "number");
+    get_attacker_tx_prob(): Promise<number> {
+        return call("get_attacker_tx_prob", "number");
     },
-    add_router(id: number, v1: number, v2: number, fraction: number, radius: number): void {
+    add_router(id: number, v1: number, v2: number, fraction: number, radius: number): Promise<boolean> {
+        // Resolves to false if the street map does not have the edge
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `add_router(${id}, ${v1}, ${v2}, ${fraction}, ${radius});\n`;
         }
-        Module.ccall("add_router", undefined, ["number", "number", "number", "number", "radius"],
+        return call("add_router", "boolean", ["number", "number", "number", "number", "radius"],
             [id, v1, v2, fraction, radius]);
     },
-    get_router_id_by_index(index: number): number {
-        return Module.ccall("get_router_id_by_index", "number", ["number"], [index]);
+    sample_router_layout(n: number, radius: number): Promise<Float32Array> {
+        // Adds n routers on random edges weighted by their length, the result holds [v1, v2, fraction] per router
+        if (debug) {
+            const code = document.getElementById("code") as HTMLTextAreaElement;
+            code.value += `sample_router_layout(${n}, ${radius});\n`;
+        }
+        return post({type: "sample_router_layout", n, radius});
+    },
+    get_router_id_by_index(index: number): Promise<number> {
+        return call("get_router_id_by_index", "number", ["number"], [index]);
     },
-    get_router_v1_by_index(index: number): number {
-        return Module.ccall("get_router_v1_by_index", "number", ["number"], [index]);
+    get_router_v1_by_index(index: number): Promise<number> {
+        return call("get_router_v1_by_index", "number", ["number"], [index]);
     },
-    get_router_v2_by_index(index: number): number {
-        return Module.ccall("get_router_v2_by_index", "number", ["number"], [index]);
+    get_router_v2_by_index(index: number): Promise<number> {
+        return call("get_router_v2_by_index", "number", ["number"], [index]);
     },
-    get_router_fraction_by_index(index: number): number {
-        return Module.ccall("get_router_fraction_by_index", "number", ["number"], [index]);
+    get_router_fraction_by_index(index: number): Promise<number> {
+        return call("get_router_fraction_by_index", "number", ["number"], [index]);
     },
-    get_router_x_by_index(index: number): number {
-        return Module.ccall("get_router_x_by_index", "number", ["number"], [index]);
+    get_router_x_by_index(index: number): Promise<number> {
+        return call("get_router_x_by_index", "number", ["number"], [index]);
     },
-    get_router_y_by_index(index: number): number {
-        return Module.ccall("get_router_y_by_index", "number", ["number"], [index]);
+    get_router_y_by_index(index: number): Promise<number> {
+        return call("get_router_y_by_index", "number", ["number"], [index]);
     },
-    get_router_radius_by_index(index: number): number {
-        return Module.ccall("get_router_radius_by_index", "number", ["number"], [index]);
+    get_router_radius_by_index(index: number): Promise<number> {
+        return call("get_router_radius_by_index", "number", ["number"], [index]);
     },
-    get_router_active_by_index(index: number): boolean {
-        return Module.ccall("get_router_active_by_index", "number", ["number"], [index]);
+    get_router_active_by_index(index: number): Promise<boolean> {
+        return call("get_router_active_by_index", "number", ["number"], [index]);
     },
-    get_router_active_since_by_index(index: number): number {
-        return Module.ccall("get_router_active_since_by_index", "number", ["number"], [index]);
+    get_router_active_since_by_index(index: number): Promise<number> {
+        return call("get_router_active_since_by_index", "number", ["number"], [index]);
     },
-    get_router_index_by_id(id: number): number {
-        return Module.ccall("get_router_index_by_id", "number", ["number"], [id]);
+    get_router_index_by_id(id: number): Promise<number> {
+        return call("get_router_index_by_id", "number", ["number"], [id]);
     },
-    count_routers(): number {
-        return Module.ccall("count_routers", "number");
+    count_routers(): Promise<number> {
+        return call("count_routers", "number");
     },
-    metric_activity(): number {
-        return Module.ccall("metric_activity", "number");
+    metric_activity(): Promise<number> {
+        return call("metric_activity", "number");
     },
-    metric_detection(): number {
-        return Module.ccall("metric_detection", "number");
+    metric_detection(): Promise<number> {
+        return call("metric_detection", "number");
     },
-    metric_last_tracking(): number {
-        return Module.ccall("metric_last_tracking", "number");
+    metric_last_tracking(): Promise<number> {
+        return call("metric_last_tracking", "number");
     },
-    metric_path(): number {
-        return Module.ccall("metric_path", "number");
+    metric_path(): Promise<number> {
+        return call("metric_path", "number");
     },
-    get_path_length(): number {
-        return Module.ccall("get_path_length", "number");
+    get_path_length(): Promise<number> {
+        return call("get_path_length", "number");
     },
-    get_path_node(index: number): number {
-        return Module.ccall("get_path_node", "number", ["number"], [index]);
+    get_path_node(index: number): Promise<number> {
+        return call("get_path_node", "number", ["number"], [index]);
     },
-    pop_event(): boolean {
-        return Module.ccall("pop_event", "boolean");
+    pop_event(): Promise<boolean> {
+        return call("pop_event", "boolean");
     },
-    event_is_router_detects(): boolean {
-        return Module.ccall("event_is_router_detects", "boolean");
+    event_is_router_detects(): Promise<boolean> {
+        return call("event_is_router_detects", "boolean");
     },
-    event_is_router_misses(): boolean {
-        return Module.ccall("event_is_router_misses", "boolean");
+    event_is_router_misses(): Promise<boolean> {
+        return call("event_is_router_misses", "boolean");
     },
-    event_router_get_index(): number {
-        return Module.ccall("event_router_get_index", "number");
+    event_router_get_index(): Promise<number> {
+        return call("event_router_get_index", "number");
     },
-    event_get_tick(): number {
-        return Module.ccall("event_get_tick", "number");
+    event_get_tick(): Promise<number> {
+        return call("event_get_tick", "number");
     },
-    random_weighted_edge_new(): void {
-        Module.ccall("random_weighted_edge_new");
+    random_weighted_edge_new(): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `random_weighted_edge_new();\n`;
         }
+        return call("random_weighted_edge_new");
     },
-    random_weighted_edge_v1(): number {
-        return Module.ccall("random_weighted_edge_v1", "number");
+    random_weighted_edge_v1(): Promise<number> {
+        return call("random_weighted_edge_v1", "number");
     },
-    random_weighted_edge_v2(): number {
-        return Module.ccall("random_weighted_edge_v2", "number");
+    random_weighted_edge_v2(): Promise<number> {
+        return call("random_weighted_edge_v2", "number");
     },
-    do_tick(): void {
+    do_tick(): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `do_tick();\n`;
         }
-        Module.ccall("do_tick");
+        return call("do_tick");
     },
-    get_tick(): number {
-        return Module.ccall("get_tick", "number");
+    do_ticks(n: number): Promise<TickFrame> {
+        if (debug) {
+            const code = document.getElementById("code") as HTMLTextAreaElement;
+            code.value += `do_ticks(${n});\n`;
+        }
+        return post({type: "do_ticks", n});
     },
-    is_done(): boolean {
-        return Module.ccall("is_done", "boolean");
+    async random_weighted_edge(): Promise<[number, number]> {
+        this.random_weighted_edge_new();
+        const v1 = this.random_weighted_edge_v1(), v2 = this.random_weighted_edge_v2();
+        return [await v1, await v2];
     },
-    reset(): void {
-        Module.ccall("reset");
+    simulate(count: number, delay = 0, onFrame?: (frame: TickFrame) => void): Promise<{ ticks: number, done: boolean }> {
+        // Advances the simulation inside the worker until count ticks are done (all ticks for count < 0) or stop is
+        // called. With a delay every tick is published, otherwise the state is published once per batch.
+        frameListener = onFrame;
+        return post({type: "simulate", count, delay, batch: delay ? 1 : 1024, log: !!onFrame});
+    },
+    run_batch(strategies: Float32Array, runs: number, replaceAttacker: boolean, minPathLength: number): Promise<Float32Array> {
+        // strategies holds BatchStrategy.Size values per strategy, the result holds the metrics as [strategy][metric][run]
+        if (debug) {
+            const code = document.getElementById("code") as HTMLTextAreaElement;
+            code.value += `run_batch([${strategies}], ${runs}, ${replaceAttacker}, ${minPathLength});\n`;
+        }
+        return post({type: "run_batch", strategies, runs, replaceAttacker, minPathLength});
+    },
+    stop(): void {
+        Atomics.store(ringI32, Ring.Stop, 1);
+    },
+    init_ring(routerCount: number): Promise<void> {
+        const routerWords = Math.ceil(routerCount / 32);
+        ring = new SharedArrayBuffer(4 * (Ring.HeaderSize + ringSlots * (Slot.HeaderSize + routerWords)));
+        ringI32 = new Int32Array(ring);
+        ringF32 = new Float32Array(ring);
+        ringI32[Ring.Slots] = ringSlots;
+        ringI32[Ring.RouterWords] = routerWords;
+        lastSequence = 0;
+        return post({type: "ring", ring});
+    },
+    sample(): StateSample | undefined {
+        // Returns the latest published state if it changed since the last call
+        const sequence = Atomics.load(ringI32, Ring.Sequence);
+        if (sequence == lastSequence) return undefined;
+
+        const routerWords = ringI32[Ring.RouterWords];
+        const slot = Ring.HeaderSize + (sequence % ringI32[Ring.Slots]) * (Slot.HeaderSize + routerWords);
+        const sample: StateSample = {
+            tick: ringI32[slot + Slot.Tick],
+            done: ringI32[slot + Slot.Done] != 0,
+            attacker: {
+                edge: [ringI32[slot + Slot.AttackerV1], ringI32[slot + Slot.AttackerV2]],
+                fraction: ringF32[slot + Slot.AttackerFraction],
+                position: [ringF32[slot + Slot.AttackerX], ringF32[slot + Slot.AttackerY]]
+            },
+            active: ringI32.slice(slot + Slot.HeaderSize, slot + Slot.HeaderSize + routerWords)
+        };
+        if (Atomics.load(ringI32, slot + Slot.Sequence) != sequence) return undefined; // Overwritten while reading
+        lastSequence = sequence;
+        return sample;
+    },
+    create_instance(): Promise<number> {
+        return post({type: "create"});
+    },
+    fork_instance(seed: number, scenario?: number): Promise<number> {
+        // The new instance shares the street map and copies the routers of the scenario (the displayed instance
+        // by default), the street map of the scenario must not be modified while the fork exists
+        return post({type: "create", scenario, seed});
+    },
+    destroy_instance(handle: number): Promise<void> {
+        return post({type: "destroy", handle});
+    },
+    call_instance(handle: number, func: string, returnType?: string, argTypes?: string[], args?: any[]): Promise<any> {
+        return call(func, returnType, argTypes, args, handle);
+    },
+    run_parallel(handles: number[]): Promise<void> {
+        // Simulates the instances to completion, each on its own thread of the worker
+        return post({type: "run_parallel", handles});
+    },
+    get_tick(): Promise<number> {
+        return call("get_tick", "number");
+    },
+    is_done(): Promise<boolean> {
+        return call("is_done", "boolean");
+    },
+    reset(): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value += `reset();\n`;
         }
+        return call("reset");
     },
-    full_reset(): void {
-        Module.ccall("full_reset");
+    full_reset(): Promise<void> {
         if (debug) {
             const code = document.getElementById("code") as HTMLTextAreaElement;
             code.value = `full_reset();\n`;
         }
+        return call("full_reset");
     }
 };
@@ -58,6 +58,27 @@ export type SimulationEvent = {
     }>
 };
 
+export type TickFrame = {
+    ticks: number;
+    tick: number;
+    done: boolean;
+    attacker: {
+        edge: [number, number];
+        fraction: number;
+        position: [number, number];
+    };
+    events: {
+        type: EventType.RouterDetects | EventType.RouterMisses;
+        tick: number;
+        router: number;
+        position: [number, number];
+    }[];
+    routers: {
+        index: number;
+        active: boolean;
+    }[];
+};
+
 export type Strategy = {
     type: "sample",
     activationDistance: number
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Aggregation.hpp"
+
+void RunningMoments::add(double x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / (double) n;
+    m2 += delta * (x - mean);
+}
+
+double RunningMoments::confidenceHalfWidth(double confidence) const {
+    if (n < 2) return INFINITY;
+    return studentQuantile(0.5 + confidence / 2, (double) (n - 1)) * sqrt(variance() / (double) n);
+}
+
+double normalQuantile(double p) {
+    // Acklam's rational approximation, the relative error is below 1.15e-9
+    const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02,
+                        -3.066479806614716e+01, 2.506628277459239e+00};
+    const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01,
+                        -1.328068155288572e+01};
+    const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00,
+                        4.374664141464968e+00, 2.938163982698783e+00};
+    const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+    const double low = 0.02425;
+
+    if (p <= 0) return -INFINITY;
+    if (p >= 1) return INFINITY;
+    if (p < low) {
+        double q = sqrt(-2 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    if (p > 1 - low) return -normalQuantile(1 - p);
+    double q = p - 0.5, r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+static double studentCdf(double t, int v) {
+    // Closed form for integer degrees of freedom (Abramowitz and Stegun 26.7.3 and 26.7.4)
+    double theta = atan(t / sqrt((double) v)), c2 = cos(theta) * cos(theta), term = 1, sum = 1;
+    for (int j = v % 2 ? 2 : 1; j <= v - 3; j += 2) {
+        term *= (double) j / (double) (j + 1) * c2;
+        sum += term;
+    }
+    double a = v % 2 ? 2 / M_PI * (theta + (v > 1 ? sin(theta) * cos(theta) * sum : 0)) : sin(theta) * sum;
+    return (1 + a) / 2;
+}
+
+double studentQuantile(double p, double degreesOfFreedom) {
+    // Cornish-Fisher expansion around the normal quantile, within 0.1% from 30 degrees of freedom on
+    double z = normalQuantile(p), z2 = z * z, v = degreesOfFreedom;
+    double g1 = (z2 + 1) * z / 4;
+    double g2 = ((5 * z2 + 16) * z2 + 3) * z / 96;
+    double g3 = (((3 * z2 + 19) * z2 + 17) * z2 - 15) * z / 384;
+    double t = z + g1 / v + g2 / (v * v) + g3 / (v * v * v);
+    if (v >= 30 || v != floor(v) || !std::isfinite(t)) return t;
+
+    // The expansion is several percent low for few degrees of freedom, Newton steps on the exact CDF correct it
+    double logScale = lgamma((v + 1) / 2) - lgamma(v / 2) - log(v * M_PI) / 2;
+    for (int i = 0; i < 8; i++) {
+        double step = (studentCdf(t, (int) v) - p) / exp(logScale - (v + 1) / 2 * log1p(t * t / v));
+        t -= step;
+        if (fabs(step) <= 1e-12 * fabs(t)) break;
+    }
+    return t;
+}
+
+void P2Quantile::add(double x) {
+    if (n < 5) {
+        heights[n++] = x;
+        if (n == 5) {
+            std::sort(heights, heights + 5);
+            for (int i = 0; i < 5; i++) positions[i] = i + 1;
+            desired[0] = 1, desired[1] = 1 + 2 * p, desired[2] = 1 + 4 * p, desired[3] = 3 + 2 * p, desired[4] = 5;
+            increments[0] = 0, increments[1] = p / 2, increments[2] = p, increments[3] = (1 + p) / 2, increments[4] = 1;
+        }
+        return;
+    }
+    n++;
+
+    // Marker cell of x, the outer markers track the extremes
+    int cell;
+    if (x < heights[0]) {
+        heights[0] = x;
+        cell = 0;
+    } else if (x >= heights[4]) {
+        heights[4] = x;
+        cell = 3;
+    } else {
+        cell = 0;
+        while (x >= heights[cell + 1]) cell++;
+    }
+    for (int i = cell + 1; i < 5; i++) positions[i]++;
+    for (int i = 0; i < 5; i++) desired[i] += increments[i];
+
+    // Moves the inner markers towards their desired positions
+    for (int i = 1; i < 4; i++) {
+        double d = desired[i] - positions[i];
+        if ((d >= 1 && positions[i + 1] - positions[i] > 1) || (d <= -1 && positions[i - 1] - positions[i] < -1)) {
+            int step = d > 0 ? 1 : -1;
+            double height = parabolic(i, step);
+            if (heights[i - 1] < height && height < heights[i + 1]) heights[i] = height;
+            else heights[i] = linear(i, step);
+            positions[i] += step;
+        }
+    }
+}
+
+double P2Quantile::parabolic(int i, double d) const {
+    return heights[i] + d / (positions[i + 1] - positions[i - 1]) *
+                        ((positions[i] - positions[i - 1] + d) * (heights[i + 1] - heights[i]) / (positions[i + 1] - positions[i]) +
+                         (positions[i + 1] - positions[i] - d) * (heights[i] - heights[i - 1]) / (positions[i] - positions[i - 1]));
+}
+
+double P2Quantile::linear(int i, int d) const {
+    return heights[i] + d * (heights[i + d] - heights[i]) / (positions[i + d] - positions[i]);
+}
+
+double P2Quantile::value() const {
+    if (n >= 5) return heights[2];
+    if (n == 0) return NAN;
+    // Insertion sort of the first samples. std::sort on a fixed array makes GCC warn about its path for long ranges.
+    double sorted[5];
+    auto count = std::min<int64_t>(n, 5);
+    for (int64_t i = 0; i < count; i++) {
+        int64_t j = i;
+        for (; j > 0 && sorted[j - 1] > heights[i]; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = heights[i];
+    }
+    return sorted[std::min<int64_t>(count - 1, (int64_t) (p * (double) count))];
+}
+
+void MetricSummary::add(double x) {
+    moments.add(x);
+    p10.add(x);
+    p50.add(x);
+    p90.add(x);
+}
+
+bool AdaptiveStopping::converged(const std::string &key) const {
+    auto it = moments.find(key);
+    if (it == moments.end() || it->second.count() < minRuns) return false;
+    return 2 * it->second.confidenceHalfWidth(confidence) <= width;
+}
+
+bool AdaptiveStopping::allConverged() const {
+    if (moments.empty()) return false;
+    for (const auto &entry: moments) {
+        if (!converged(entry.first)) return false;
+    }
+    return true;
+}
+
+void AggregateResultSink::encode(const std::vector<RunResult> &/*results*/, std::string &/*out*/) const {
+    // The runs are not written, finish writes the summaries
+}
+
+void AggregateResultSink::append(const std::vector<RunResult> &results, std::string &/*buffer*/) {
+    std::unique_lock<std::mutex> lock(configurationsLock);
+    for (const auto &result: results) {
+        auto inserted = configurationIndex.emplace(result.configurationKey(), configurations.size());
+        if (inserted.second) configurations.push_back({result, {}});
+        auto &configuration = configurations[inserted.first->second];
+        for (int i = 0; i < metric_count; i++) configuration.metrics[i].add(result.metrics[i]);
+    }
+}
+
+void AggregateResultSink::finish() {
+    std::unique_lock<std::mutex> lock(configurationsLock);
+    std::string out;
+    for (const auto &configuration: configurations) {
+        CsvResultSink::appendKey(out, configuration.key);
+        out += std::to_string(configuration.metrics[0].moments.count());
+        for (const auto &metric: configuration.metrics) {
+            for (double value: {metric.moments.average(), sqrt(metric.moments.variance()), metric.p10.value(),
+                                metric.p50.value(), metric.p90.value()}) {
+                out += ',';
+                CsvResultSink::appendNumber(out, (float) value);
+            }
+        }
+        out += '\n';
+    }
+    write(out);
+}
@@ -0,0 +1,89 @@
+#ifndef CHASE_SIMULATOR_AGGREGATION_HPP
+#define CHASE_SIMULATOR_AGGREGATION_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ResultSink.hpp"
+
+// Running mean and variance (Welford)
+class RunningMoments {
+    int64_t n = 0;
+    double mean = 0, m2 = 0;
+public:
+    void add(double x);
+
+    [[nodiscard]] int64_t count() const { return n; };
+    [[nodiscard]] double average() const { return mean; };
+    [[nodiscard]] double variance() const { return n > 1 ? m2 / (double) (n - 1) : 0; }; // Sample variance
+
+    // Half width of the Student t confidence interval of the mean, infinite for less than two samples
+    [[nodiscard]] double confidenceHalfWidth(double confidence) const;
+};
+
+double normalQuantile(double p);
+double studentQuantile(double p, double degreesOfFreedom);
+
+// Estimates a quantile in constant memory with the P² algorithm of Jain and Chlamtac, exact for up to five samples
+class P2Quantile {
+    double p;
+    int64_t n = 0;
+    double heights[5] = {0};
+    double positions[5] = {0}, desired[5] = {0}, increments[5] = {0};
+
+    double parabolic(int i, double d) const;
+    double linear(int i, int d) const;
+public:
+    explicit P2Quantile(double p) : p(p) {};
+    void add(double x);
+    [[nodiscard]] double value() const;
+};
+
+struct MetricSummary {
+    RunningMoments moments;
+    P2Quantile p10{0.1}, p50{0.5}, p90{0.9};
+
+    void add(double x);
+};
+
+// Decides when a configuration has enough runs: once the confidence interval of its metric is at most width wide
+class AdaptiveStopping {
+    double width, confidence;
+    int64_t minRuns;
+    std::unordered_map<std::string, RunningMoments> moments;
+public:
+    AdaptiveStopping(double width, double confidence, int64_t minRuns) :
+            width(width), confidence(confidence), minRuns(minRuns) {};
+
+    void add(const std::string &key, double value) { moments[key].add(value); };
+    [[nodiscard]] bool converged(const std::string &key) const;
+    [[nodiscard]] bool allConverged() const; // False as long as no configuration has run
+    void clear() { moments.clear(); };
+};
+
+// Keeps one summary per configuration instead of the runs and writes them as csv once the sweep is finished:
+//   map, routers, tx_prob, strategy, parameter_t columns, runs, (mean, std, p10, p50, p90) per metric_t
+class AggregateResultSink : public ResultSink {
+    struct Configuration {
+        RunResult key;
+        MetricSummary metrics[metric_count];
+    };
+
+    std::mutex configurationsLock;
+    std::vector<Configuration> configurations; // In the order of their first run
+    std::unordered_map<std::string, size_t> configurationIndex;
+
+protected:
+    void encode(const std::vector<RunResult> &results, std::string &out) const override;
+
+public:
+    using ResultSink::ResultSink;
+
+    void append(const std::vector<RunResult> &results, std::string &buffer) override;
+    void finish() override;
+};
+
+#endif //CHASE_SIMULATOR_AGGREGATION_HPP
@@ -0,0 +1,36 @@
+#include "AliasTable.hpp"
+
+using namespace watchman::simulator;
+
+void AliasTable::build(const std::vector<float> &weights) {
+    std::size_t n = weights.size();
+    probability.assign(n, 1);
+    alias.resize(n);
+    for (int i = 0; i < n; i++) alias[i] = i;
+    if (n == 0) return;
+
+    double total = 0;
+    for (auto w: weights) total += w;
+
+    // Columns below the average are filled up with the excess of the columns above it
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; i++) {
+        scaled[i] = weights[i] * (double) n / total;
+        (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        probability[s] = (float) scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is full up to rounding errors
+    for (auto i: small) probability[i] = 1;
+    for (auto i: large) probability[i] = 1;
+}
@@ -0,0 +1,26 @@
+#ifndef CHASE_SIMULATOR_ALIASTABLE_HPP
+#define CHASE_SIMULATOR_ALIASTABLE_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace watchman::simulator {
+
+    // Walker's alias method (in Vose's variant) for sampling indices proportional to their weight in O(1)
+    class AliasTable {
+        std::vector<float> probability;
+        std::vector<int> alias;
+
+    public:
+        void build(const std::vector<float> &weights);
+
+        [[nodiscard]] std::size_t size() const { return probability.size(); };
+
+        // column is uniform in [0, size), coin is uniform in [0, 1)
+        [[nodiscard]] int sample(int column, float coin) const {
+            return coin < probability[column] ? column : alias[column];
+        };
+    };
+}
+
+#endif //CHASE_SIMULATOR_ALIASTABLE_HPP
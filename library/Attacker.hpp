@@ -7,6 +7,7 @@ namespace watchman::simulator {
     class Attacker {
     public:
         edge_t edge;
+        int edgeId;
         float fraction;
         position_t position;
 
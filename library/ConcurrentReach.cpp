@@ -3,27 +3,34 @@
 #endif
 
 #include "ConcurrentReach.hpp"
+#include "Profiler.hpp"
 
 
 using namespace watchman::simulator;
 
-ConcurrentReach::ConcurrentReach() :
-        clustering(nullptr), threadPool(std::thread::hardware_concurrency()) {
-}
+// Pool the current thread works for, batches submitted from a worker run inline instead of waiting on their own pool
+static thread_local const ThreadPool *currentPool = nullptr;
 
-std::vector<std::vector<Router>> ConcurrentReach::precalculate(const std::vector<position_t> &positions) {
+ConcurrentReach::ConcurrentReach() : ConcurrentReach(&ThreadPool::shared()) {
+}
 
-    size_t numberOfJobs = positions.size() / 32;
-    if (numberOfJobs > threadPool.size()) numberOfJobs = threadPool.size();
+ConcurrentReach::ConcurrentReach(ThreadPool *pThreadPool) : clustering(nullptr), threadPool(pThreadPool) {
+    // Without a thread pool the reach is calculated on the calling thread
+}
 
+std::vector<std::vector<Router>> ConcurrentReach::precalculate(const std::vector<position_t> &positions) {
+    PROFILE_SCOPE(phase_reach);
     std::vector<std::vector<Router>> output(positions.size());
     if (!clustering) return output;
-    int done = 0;
-    std::mutex doneLock;
-    std::condition_variable doneCondition;
 
+    size_t numberOfJobs = positions.size() / 32;
+    if (threadPool && numberOfJobs > threadPool->size()) numberOfJobs = threadPool->size();
+    if (numberOfJobs == 0) numberOfJobs = 1; // Short trajectories are calculated as a single job
+
+    std::vector<ThreadPool::Job> jobs;
     for (int i = 0; i < numberOfJobs; i++) {
-        threadPool.addJob([this, &output, numberOfJobs, i, &positions, &done, &doneLock, &doneCondition]() {
+        jobs.emplace_back([this, &output, numberOfJobs, i, &positions]() {
+            PROFILE_SCOPE(phase_reach_job);
             for (size_t j = (i * positions.size()) / numberOfJobs;
                  j < ((i + 1) * positions.size()) / numberOfJobs; j++) {
                 for (auto it = clustering->iterator(positions[j]); it.hasNext(); it.next()) {
@@ -33,24 +40,13 @@ std::vector<std::vector<Router>> ConcurrentReach::precalculate(const std::vector
                 std::cout << "output[" << j << "].size()=" << output[j].size() << std::endl;
 #endif
             }
-
-            {
-                std::unique_lock<std::mutex> lock(doneLock);
-                done += 1;
-            }
-            doneCondition.notify_one();
         });
     }
 
-    {
-        std::unique_lock<std::mutex> lock(doneLock);
-        doneCondition.wait(lock, [&done, numberOfJobs]() {
-#ifdef DEBUG
-//            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-//            std::cout << "done=" << done << std::endl;
-#endif
-            return done == numberOfJobs;
-        });
+    if (threadPool) {
+        threadPool->runAll(jobs);
+    } else {
+        for (auto &job: jobs) job();
     }
     return output;
 }
@@ -62,6 +58,7 @@ ThreadPool::ThreadPool(size_t num_threads) {
 }
 
 void ThreadPool::worker() {
+    currentPool = this;
     while (true) {
         Job job;
         {
@@ -91,7 +88,44 @@ void ThreadPool::addJob(const ThreadPool::Job &job) {
     jobsCondition.notify_one();
 }
 
+void ThreadPool::runAll(const std::vector<Job> &batch) {
+    if (threads.empty() || currentPool == this) {
+        for (auto &job: batch) job();
+        return;
+    }
+
+    size_t done = 0;
+    std::mutex doneLock;
+    std::condition_variable doneCondition;
+    for (auto &job: batch) {
+        addJob([&job, &done, &doneLock, &doneCondition]() {
+            job();
+            {
+                std::unique_lock<std::mutex> lock(doneLock);
+                done += 1;
+            }
+            doneCondition.notify_one();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(doneLock);
+    doneCondition.wait(lock, [&done, &batch]() {
+        return done == batch.size();
+    });
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool threadPool(std::thread::hardware_concurrency());
+    return threadPool;
+}
+
 ThreadPool::~ThreadPool() {
-    done = true;
+    {
+        std::unique_lock<std::mutex> lock(jobsLock);
+        done = true;
+    }
     jobsCondition.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
 }
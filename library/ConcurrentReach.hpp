@@ -2,6 +2,7 @@
 #define CHASE_SIMULATOR_CONCURRENTREACH_H
 
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <utility>
@@ -10,7 +11,9 @@
 namespace watchman::simulator {
 
     class ThreadPool {
+    public:
         typedef std::function<void()> Job;
+    private:
 
         std::vector<std::thread> threads;
         std::deque<Job> jobs;
@@ -26,15 +29,19 @@ namespace watchman::simulator {
         ~ThreadPool();
 
         void addJob(const Job &job);
+        void runAll(const std::vector<Job> &batch);
 
         [[nodiscard]] auto size() const { return threads.size(); };
+
+        static ThreadPool &shared();
     };
 
     class ConcurrentReach {
         Clustering *clustering;
-        ThreadPool threadPool;
+        ThreadPool *threadPool;
     public:
         explicit ConcurrentReach();
+        explicit ConcurrentReach(ThreadPool *pThreadPool);
 
         std::vector<std::vector<Router>> precalculate(const std::vector<position_t> &positions);
 
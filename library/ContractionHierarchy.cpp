@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include "ContractionHierarchy.hpp"
+
+using namespace watchman::simulator;
+
+static const float infinity = std::numeric_limits<float>::infinity();
+
+// Witness searches give up after settling this many vertices and keep the shortcut, which is always correct. Estimating
+// the priority only needs the number of shortcuts roughly, a short search is enough there. Contracting with a short
+// search adds superfluous shortcuts that grow the upper levels and with them the queries, on a 128 x 128 grid
+// a limit of 64 doubles the vertices a query settles.
+static const int witnessSettleLimit = 1000;
+static const int estimateSettleLimit = 64;
+
+static const uint32_t fileMagic = 0x43484d31; // "CHM1"
+
+namespace {
+    struct Arc {
+        int to;
+        float weight;
+        int middle;
+    };
+
+    // Dijkstra state that is reused between searches, a vertex only counts as visited in the current search
+    struct SearchSpace {
+        std::vector<float> distances;
+        std::vector<int> parents; // Edge the vertex was reached by, -1 for the start vertices
+        std::vector<unsigned> visited;
+        std::vector<std::pair<float, int>> queue;
+        unsigned search = 0;
+
+        void start(size_t n) {
+            if (visited.size() != n) {
+                distances.assign(n, 0);
+                parents.assign(n, -1);
+                visited.assign(n, 0);
+                search = 0;
+            }
+            if (++search == 0) {
+                std::fill(visited.begin(), visited.end(), 0);
+                search = 1;
+            }
+            queue.clear();
+        }
+
+        [[nodiscard]] bool reached(int v) const { return visited[v] == search; }
+
+        bool relax(int v, float distance, int parent) {
+            if (reached(v) && distance >= distances[v]) return false;
+            distances[v] = distance;
+            parents[v] = parent;
+            visited[v] = search;
+            queue.emplace_back(distance, v);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>());
+            return true;
+        }
+
+        // Smallest queued distance, outdated entries are dropped
+        float top() {
+            while (!queue.empty() && queue.front().first > distances[queue.front().second]) {
+                std::pop_heap(queue.begin(), queue.end(), std::greater<>());
+                queue.pop_back();
+            }
+            return queue.empty() ? infinity : queue.front().first;
+        }
+
+        int pop() {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>());
+            int v = queue.back().second;
+            queue.pop_back();
+            return v;
+        }
+    };
+
+    thread_local SearchSpace forwardSpace, backwardSpace;
+
+    void insert_arc(std::vector<Arc> &arcs, int to, float weight, int middle) {
+        for (auto &arc: arcs) {
+            if (arc.to == to) {
+                if (weight < arc.weight) arc = {to, weight, middle};
+                return;
+            }
+        }
+        arcs.push_back({to, weight, middle});
+    }
+
+    class Contraction {
+        std::vector<std::vector<Arc>> &adjacency;
+        std::vector<bool> &contracted;
+        SearchSpace witness;
+
+        // Distance from u to the targets without passing v, only valid if the target was reached
+        void witness_search(int u, int v, float maxDistance, int settleLimit) {
+            witness.start(adjacency.size());
+            witness.relax(u, 0, -1);
+            for (int settled = 0; settled < settleLimit && witness.top() <= maxDistance; settled++) {
+                int x = witness.pop();
+                for (const auto &arc: adjacency[x]) {
+                    if (arc.to == v || contracted[arc.to]) continue;
+                    witness.relax(arc.to, witness.distances[x] + arc.weight, -1);
+                }
+            }
+        }
+
+    public:
+        Contraction(std::vector<std::vector<Arc>> &adjacency, std::vector<bool> &contracted) :
+                adjacency(adjacency), contracted(contracted) {}
+
+        // Calls shortcut(u, w, weight) for every pair of neighbours of v whose shortest path leads over v
+        template<typename Shortcut>
+        void shortcuts(int v, Shortcut shortcut, int settleLimit = witnessSettleLimit) {
+            const auto &arcs = adjacency[v];
+            float maxWeight = 0;
+            for (const auto &arc: arcs) maxWeight = std::max(maxWeight, arc.weight);
+
+            for (int i = 0; i < arcs.size(); i++) {
+                witness_search(arcs[i].to, v, arcs[i].weight + maxWeight, settleLimit);
+                for (int j = i + 1; j < arcs.size(); j++) {
+                    float weight = arcs[i].weight + arcs[j].weight;
+                    int w = arcs[j].to;
+                    if (!witness.reached(w) || witness.distances[w] > weight) {
+                        shortcut(arcs[i].to, w, weight);
+                    }
+                }
+            }
+        }
+    };
+}
+
+uint64_t ContractionHierarchy::fingerprint(size_t vertexCount, const std::vector<std::pair<int, int>> &edges,
+                                           const std::vector<float> &weights) {
+    // FNV-1a over the vertex count and the weighted edge list
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= ((const unsigned char *) data)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    uint64_t n = vertexCount;
+    mix(&n, sizeof(n));
+    for (size_t i = 0; i < edges.size(); i++) {
+        mix(&edges[i].first, sizeof(int));
+        mix(&edges[i].second, sizeof(int));
+        mix(&weights[i], sizeof(float));
+    }
+    return hash;
+}
+
+void ContractionHierarchy::build(size_t vertexCount, const std::vector<std::pair<int, int>> &edges,
+                                 const std::vector<float> &weights) {
+    int n = (int) vertexCount;
+    std::vector<std::vector<Arc>> adjacency(n);
+    for (int i = 0; i < edges.size(); i++) {
+        auto [v1, v2] = edges[i];
+        if (v1 == v2) continue;
+        insert_arc(adjacency[v1], v2, weights[i], -1);
+        insert_arc(adjacency[v2], v1, weights[i], -1);
+    }
+
+    std::vector<bool> contracted(n, false);
+    std::vector<int> contractedNeighbours(n, 0), levels(n, 0);
+    Contraction contraction(adjacency, contracted);
+
+    // Vertices that add few shortcuts compared to the edges they remove are contracted first, the contracted
+    // neighbours and the level spread the contraction evenly over the map. The edge difference has to dominate,
+    // weighting it like the contracted neighbours builds 4 times slower and queries 3 times slower on grids.
+    auto priority = [&](int v) {
+        int shortcuts = 0;
+        contraction.shortcuts(v, [&shortcuts](int, int, float) { shortcuts++; }, estimateSettleLimit);
+        return 8 * (shortcuts - (int) adjacency[v].size()) + contractedNeighbours[v] + levels[v];
+    };
+
+    std::vector<int> priorities(n);
+    std::vector<std::pair<int, int>> queue;
+    for (int v = 0; v < n; v++) {
+        priorities[v] = priority(v);
+        queue.emplace_back(priorities[v], v);
+    }
+    std::make_heap(queue.begin(), queue.end(), std::greater<>());
+
+    std::vector<std::vector<Arc>> upward(n);
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<>());
+        auto [queued, v] = queue.back();
+        queue.pop_back();
+        if (contracted[v] || queued != priorities[v]) continue; // Outdated entry
+
+        // Lazy update, the priority may have grown since the neighbours were contracted
+        priorities[v] = priority(v);
+        if (!queue.empty() && priorities[v] > queue.front().first) {
+            queue.emplace_back(priorities[v], v);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>());
+            continue;
+        }
+
+        upward[v] = adjacency[v];
+        contraction.shortcuts(v, [&adjacency, v](int u, int w, float weight) {
+            insert_arc(adjacency[u], w, weight, v);
+            insert_arc(adjacency[w], u, weight, v);
+        });
+        contracted[v] = true;
+
+        for (const auto &arc: upward[v]) {
+            auto &arcs = adjacency[arc.to];
+            arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [v](const Arc &a) { return a.to == v; }), arcs.end());
+            contractedNeighbours[arc.to]++;
+            levels[arc.to] = std::max(levels[arc.to], levels[v] + 1);
+            priorities[arc.to] = priority(arc.to);
+            queue.emplace_back(priorities[arc.to], arc.to);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>());
+        }
+        adjacency[v].clear();
+        adjacency[v].shrink_to_fit();
+    }
+
+    firstEdge.assign(1, 0);
+    edgeSource.clear();
+    edgeTarget.clear();
+    edgeWeight.clear();
+    edgeMiddle.clear();
+    for (int v = 0; v < n; v++) {
+        for (const auto &arc: upward[v]) {
+            edgeSource.push_back(v);
+            edgeTarget.push_back(arc.to);
+            edgeWeight.push_back(arc.weight);
+            edgeMiddle.push_back(arc.middle);
+        }
+        firstEdge.push_back((int) edgeTarget.size());
+    }
+    mapFingerprint = fingerprint(vertexCount, edges, weights);
+}
+
+template<typename T>
+static void write_vector(std::ostream &out, const std::vector<T> &values) {
+    uint64_t size = values.size();
+    out.write((const char *) &size, sizeof(size));
+    out.write((const char *) values.data(), (std::streamsize) (size * sizeof(T)));
+}
+
+template<typename T>
+static bool read_vector(std::istream &in, std::vector<T> &values) {
+    uint64_t size = 0;
+    if (!in.read((char *) &size, sizeof(size))) return false;
+    values.resize(size);
+    return (bool) in.read((char *) values.data(), (std::streamsize) (size * sizeof(T)));
+}
+
+bool ContractionHierarchy::save(std::ostream &out) const {
+    out.write((const char *) &fileMagic, sizeof(fileMagic));
+    out.write((const char *) &mapFingerprint, sizeof(mapFingerprint));
+    write_vector(out, firstEdge);
+    write_vector(out, edgeSource);
+    write_vector(out, edgeTarget);
+    write_vector(out, edgeWeight);
+    write_vector(out, edgeMiddle);
+    return (bool) out;
+}
+
+bool ContractionHierarchy::load(std::istream &in, uint64_t expectedFingerprint) {
+    uint32_t magic = 0;
+    uint64_t fingerprint = 0;
+    if (!in.read((char *) &magic, sizeof(magic)) || magic != fileMagic) return false;
+    if (!in.read((char *) &fingerprint, sizeof(fingerprint)) || fingerprint != expectedFingerprint) return false;
+
+    ContractionHierarchy loaded;
+    if (!read_vector(in, loaded.firstEdge) || !read_vector(in, loaded.edgeSource) ||
+        !read_vector(in, loaded.edgeTarget) || !read_vector(in, loaded.edgeWeight) ||
+        !read_vector(in, loaded.edgeMiddle)) {
+        return false;
+    }
+    loaded.mapFingerprint = fingerprint;
+    *this = std::move(loaded);
+    return true;
+}
+
+float ContractionHierarchy::search(const endpoint_t *sources, size_t sourceCount, const endpoint_t *targets,
+                                   size_t targetCount, int &meeting) const {
+    auto &forward = forwardSpace, &backward = backwardSpace;
+    forward.start(size());
+    backward.start(size());
+    for (size_t i = 0; i < sourceCount; i++) forward.relax(sources[i].first, sources[i].second, -1);
+    for (size_t i = 0; i < targetCount; i++) backward.relax(targets[i].first, targets[i].second, -1);
+
+    float best = infinity;
+    meeting = -1;
+    while (true) {
+        // Each direction stops once it cannot improve the best connection anymore
+        float forwardTop = forward.top(), backwardTop = backward.top();
+        if (std::min(forwardTop, backwardTop) >= best) break;
+
+        auto &space = forwardTop <= backwardTop ? forward : backward;
+        auto &other = forwardTop <= backwardTop ? backward : forward;
+        int v = space.pop();
+        float distance = space.distances[v];
+        if (other.reached(v) && distance + other.distances[v] < best) {
+            best = distance + other.distances[v];
+            meeting = v;
+        }
+
+        // Stall on demand: if a vertex contracted later reaches v on a shorter way, no shortest path continues
+        // upwards from v
+        bool stalled = false;
+        for (int e = firstEdge[v]; e < firstEdge[v + 1] && !stalled; e++) {
+            int u = edgeTarget[e];
+            stalled = space.reached(u) && space.distances[u] + edgeWeight[e] < distance;
+        }
+        if (stalled) continue;
+
+        for (int e = firstEdge[v]; e < firstEdge[v + 1]; e++) {
+            space.relax(edgeTarget[e], distance + edgeWeight[e], e);
+        }
+    }
+    return best;
+}
+
+int ContractionHierarchy::find_edge(int source, int target) const {
+    for (int e = firstEdge[source]; e < firstEdge[source + 1]; e++) {
+        if (edgeTarget[e] == target) return e;
+    }
+    return -1;
+}
+
+void ContractionHierarchy::unpack(int edge, bool reverse, std::vector<int> &vertices) const {
+    // Appends the vertices after the start of the edge up to its end, walking from target to source if reversed
+    int middle = edgeMiddle[edge];
+    if (middle < 0) {
+        vertices.push_back(reverse ? edgeSource[edge] : edgeTarget[edge]);
+        return;
+    }
+    // The bypassed vertex was contracted before both ends, so both halves are upward edges of it
+    int toSource = find_edge(middle, edgeSource[edge]), toTarget = find_edge(middle, edgeTarget[edge]);
+    if (reverse) {
+        unpack(toTarget, true, vertices);
+        unpack(toSource, false, vertices);
+    } else {
+        unpack(toSource, true, vertices);
+        unpack(toTarget, false, vertices);
+    }
+}
+
+float ContractionHierarchy::shortest_path(std::deque<int> &path, int src, int dest) const {
+    endpoint_t source(src, 0), target(dest, 0);
+    int meeting;
+    float length = search(&source, 1, &target, 1, meeting);
+    if (meeting < 0 || src == dest) return 0;
+
+    // The forward search reached the meeting vertex from src, the backward search from dest
+    std::vector<int> upEdges;
+    for (int e = forwardSpace.parents[meeting]; e >= 0; e = forwardSpace.parents[edgeSource[e]]) {
+        upEdges.push_back(e);
+    }
+    std::vector<int> vertices;
+    for (auto it = upEdges.rbegin(); it != upEdges.rend(); it++) {
+        unpack(*it, false, vertices);
+    }
+    for (int e = backwardSpace.parents[meeting]; e >= 0; e = backwardSpace.parents[edgeSource[e]]) {
+        unpack(e, true, vertices);
+    }
+    path.insert(path.end(), vertices.begin(), vertices.end());
+    return length;
+}
+
+float ContractionHierarchy::distance(const endpoint_t *sources, size_t sourceCount, const endpoint_t *targets,
+                                     size_t targetCount) const {
+    int meeting;
+    return search(sources, sourceCount, targets, targetCount, meeting);
+}
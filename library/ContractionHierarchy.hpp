@@ -0,0 +1,55 @@
+#ifndef CHASE_SIMULATOR_CONTRACTIONHIERARCHY_HPP
+#define CHASE_SIMULATOR_CONTRACTIONHIERARCHY_HPP
+
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace watchman::simulator {
+
+    // Contraction hierarchy of an undirected street graph. The vertices are contracted one after another, shortcuts
+    // preserve the distances between the remaining vertices. A query only follows edges to vertices contracted later,
+    // from both ends, which settles a few hundred vertices instead of the whole map.
+    // Queries can run on multiple threads at once, their search space is thread local.
+    class ContractionHierarchy {
+    public:
+        typedef std::pair<int, float> endpoint_t; // Vertex and the distance already covered to reach it
+
+    private:
+        // Upward graph in CSR form, the edges of v lead to vertices contracted after v
+        std::vector<int> firstEdge;
+        std::vector<int> edgeSource;
+        std::vector<int> edgeTarget;
+        std::vector<float> edgeWeight;
+        std::vector<int> edgeMiddle; // Vertex bypassed by a shortcut, -1 for streets
+        uint64_t mapFingerprint = 0;
+
+        float search(const endpoint_t *sources, size_t sourceCount, const endpoint_t *targets, size_t targetCount,
+                     int &meeting) const;
+        [[nodiscard]] int find_edge(int source, int target) const;
+        void unpack(int edge, bool reverse, std::vector<int> &vertices) const;
+
+    public:
+        static uint64_t fingerprint(size_t vertexCount, const std::vector<std::pair<int, int>> &edges,
+                                    const std::vector<float> &weights);
+
+        void build(size_t vertexCount, const std::vector<std::pair<int, int>> &edges, const std::vector<float> &weights);
+
+        // The stream has to be binary, a hierarchy built for another map is rejected
+        bool save(std::ostream &out) const;
+        bool load(std::istream &in, uint64_t expectedFingerprint);
+
+        [[nodiscard]] size_t size() const { return firstEdge.empty() ? 0 : firstEdge.size() - 1; };
+
+        // Same result as StreetMap::shortest_path: the path excludes src and is empty if dest is not reachable
+        float shortest_path(std::deque<int> &path, int src, int dest) const;
+
+        // Shortest distance from any of the sources to any of the targets including their offsets
+        float distance(const endpoint_t *sources, size_t sourceCount, const endpoint_t *targets, size_t targetCount) const;
+    };
+}
+
+#endif //CHASE_SIMULATOR_CONTRACTIONHIERARCHY_HPP
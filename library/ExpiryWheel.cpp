@@ -0,0 +1,7 @@
+#include "ExpiryWheel.hpp"
+
+using namespace watchman::simulator;
+
+void ExpiryWheel::reset() {
+    for (auto &slot: slots) slot.clear();
+}
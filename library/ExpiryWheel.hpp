@@ -0,0 +1,40 @@
+#ifndef CHASE_SIMULATOR_EXPIRYWHEEL_HPP
+#define CHASE_SIMULATOR_EXPIRYWHEEL_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace watchman::simulator {
+
+    // Timing wheel of router deadlines with a fixed number of slots, so its size does not depend on how far ahead the
+    // deadlines lie. A deadline further away than one turn stays in its slot and is passed over until its round comes,
+    // expiring a tick only touches the routers of its slot. Entries are not removed when a router is activated again,
+    // the caller checks whether a deadline is still current.
+    class ExpiryWheel {
+        static constexpr std::size_t slotCount = 256;
+
+        struct entry_t {
+            int index, deadline;
+        };
+        std::vector<entry_t> slots[slotCount];
+
+    public:
+        void reset();
+
+        void schedule(int index, int deadline) { slots[(std::size_t) deadline % slotCount].push_back({index, deadline}); };
+
+        // Calls f(index) for every router whose deadline is the tick and removes it from the wheel
+        template<typename F>
+        void expire(int tick, F f) {
+            auto &slot = slots[(std::size_t) tick % slotCount];
+            std::size_t kept = 0;
+            for (auto entry: slot) {
+                if (entry.deadline <= tick) f(entry.index);
+                else slot[kept++] = entry; // Due in a later round
+            }
+            slot.resize(kept);
+        };
+    };
+}
+
+#endif //CHASE_SIMULATOR_EXPIRYWHEEL_HPP
@@ -0,0 +1,29 @@
+#include "LockstepSimulator.hpp"
+#include "Profiler.hpp"
+
+using namespace watchman::simulator;
+
+void LockstepSimulator::run(const std::vector<Strategy *> &strategies, const Simulator::attackerSetup &setup) {
+    if (strategies.empty()) return;
+    PROFILE_COUNT(counter_runs, strategies.size());
+    while (followers.size() + 1 < strategies.size()) {
+        followers.emplace_back(new Simulator(leader, 0));
+        followers.back()->follow(&leader);
+    }
+
+    // The leader sets up the attacker first, the followers copy its path
+    for (size_t i = 0; i < strategies.size(); i++) {
+        auto &simulator = lane(i);
+        simulator.reset();
+        simulator.setStrategy(strategies[i]);
+        simulator.setAttacker(setup.v1, setup.v2, setup.target, setup.fraction, setup.speed, setup.tx_prob,
+                              setup.alpha_router_index, 0);
+    }
+
+    while (!leader.isDone()) {
+        leader.doTick();
+        for (size_t i = 1; i < strategies.size(); i++) {
+            lane(i).doTick();
+        }
+    }
+}
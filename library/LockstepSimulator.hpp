@@ -0,0 +1,28 @@
+#ifndef CHASE_SIMULATOR_LOCKSTEPSIMULATOR_HPP
+#define CHASE_SIMULATOR_LOCKSTEPSIMULATOR_HPP
+
+#include <memory>
+#include <vector>
+
+#include "Simulator.hpp"
+
+namespace watchman::simulator {
+
+    // Runs several strategies against one attacker in lockstep, one lane per strategy. The leader, lane 0, calculates
+    // the trajectory, the reach and the packets of every tick once, the other lanes follow it and only apply their
+    // strategy to their own copy of the routers. Lanes are forked from the leader's routers when they are first needed,
+    // so a lockstep simulator has to be recreated after the router layout changes.
+    class LockstepSimulator {
+        Simulator &leader;
+        std::vector<std::unique_ptr<Simulator>> followers;
+    public:
+        explicit LockstepSimulator(Simulator &leader) : leader(leader) {};
+
+        [[nodiscard]] Simulator &lane(size_t i) { return i == 0 ? leader : *followers[i - 1]; };
+
+        // Runs strategies[i] on lane i until the attacker arrived, the lanes take ownership of the strategies
+        void run(const std::vector<Strategy *> &strategies, const Simulator::attackerSetup &setup);
+    };
+}
+
+#endif //CHASE_SIMULATOR_LOCKSTEPSIMULATOR_HPP
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "ConcurrentReach.hpp"
+#include "NeighborhoodCache.hpp"
+#include "Profiler.hpp"
+
+using namespace watchman::simulator;
+
+std::shared_ptr<const neighborhood_lists_t> NeighborhoodCache::get(const key_t &key, const compute_t &compute) {
+    std::promise<std::shared_ptr<const neighborhood_lists_t>> promise;
+    entry_t entry;
+    bool computing = false;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            it = entries.emplace(key, promise.get_future().share()).first;
+            computing = true;
+        }
+        entry = it->second;
+    }
+    if (!computing) return entry.get(); // Waits while another thread computes the lists
+
+    PROFILE_SCOPE(phase_neighbourhoods);
+    auto lists = std::make_shared<neighborhood_lists_t>();
+    compute(*lists);
+    promise.set_value(lists);
+    return lists;
+}
+
+std::shared_ptr<const neighborhood_lists_t> NeighborhoodCache::get(const key_t &key, size_t routerCount,
+                                                                   const compute_router_t &compute) {
+    return get(key, [routerCount, &compute](neighborhood_lists_t &lists) {
+        lists.resize(routerCount);
+        auto &threadPool = ThreadPool::shared();
+        size_t numberOfJobs = std::max<size_t>(1, std::min(threadPool.size(), routerCount / 64));
+        std::vector<ThreadPool::Job> jobs;
+        for (size_t i = 0; i < numberOfJobs; i++) {
+            jobs.emplace_back([&lists, &compute, routerCount, numberOfJobs, i]() {
+                for (size_t router = (i * routerCount) / numberOfJobs; router < ((i + 1) * routerCount) / numberOfJobs; router++) {
+                    compute((int) router, lists[router]);
+                }
+            });
+        }
+        threadPool.runAll(jobs);
+    });
+}
+
+bool NeighborhoodCache::empty() {
+    std::unique_lock<std::mutex> guard(lock);
+    return entries.empty();
+}
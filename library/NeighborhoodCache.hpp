@@ -0,0 +1,47 @@
+#ifndef CHASE_SIMULATOR_NEIGHBORHOODCACHE_HPP
+#define CHASE_SIMULATOR_NEIGHBORHOODCACHE_HPP
+
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace watchman::simulator {
+
+    typedef std::vector<std::vector<int>> neighborhood_lists_t; // Indices of the neighbors per router index, ascending
+
+    typedef enum {
+        neighborhood_euclidean,  // Routers within the euclidean distance
+        neighborhood_street,     // Routers closer than the distance on the street graph
+        neighborhood_k_smartest  // kSN, the parameter is k and the distance the maximum distance
+    } neighborhood_metric_t;
+
+    // Activation neighborhoods of the routers of one layout, shared by all strategies and runs on it. A simulator
+    // starts a new cache whenever its routers change, forks of a simulator share its cache. Safe to use from several
+    // threads, each neighborhood is computed once by the first strategy that asks for it. Strategies asking for the same
+    // one wait for it, the others are not held up.
+    class NeighborhoodCache {
+    public:
+        typedef std::tuple<neighborhood_metric_t, float, int> key_t; // Metric, distance, parameter
+        typedef std::function<void(neighborhood_lists_t &lists)> compute_t;
+        typedef std::function<void(int router, std::vector<int> &list)> compute_router_t;
+
+    private:
+        typedef std::shared_future<std::shared_ptr<const neighborhood_lists_t>> entry_t;
+
+        std::mutex lock; // Only guards the map, the lists are computed outside of it
+        std::map<key_t, entry_t> entries;
+
+    public:
+        std::shared_ptr<const neighborhood_lists_t> get(const key_t &key, const compute_t &compute);
+        // Computes the lists of the routers independently of each other on the shared thread pool
+        std::shared_ptr<const neighborhood_lists_t> get(const key_t &key, size_t routerCount, const compute_router_t &compute);
+
+        [[nodiscard]] bool empty();
+    };
+}
+
+#endif //CHASE_SIMULATOR_NEIGHBORHOODCACHE_HPP
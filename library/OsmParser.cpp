@@ -0,0 +1,105 @@
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include "rapidxml/rapidxml.hpp"
+#include "rapidxml/rapidxml_utils.hpp"
+#include "OsmParser.hpp"
+
+ParsedOsm parseOsm(const char *filename) {
+    rapidxml::file<> file(filename);
+    rapidxml::xml_document<> doc;
+    doc.parse<0>(file.data());
+    std::map<long long, rapidxml::xml_node<> *> nodes;
+    auto *osm = doc.first_node("osm");
+
+    const float lonToKm = 71.47, latToKm = 111.19;
+
+    // Parse bounds
+    auto *bounds = osm->first_node("bounds");
+    auto *minlatAttr = bounds->first_attribute("minlat");
+    float minlat = strtof(minlatAttr->value(), nullptr) * latToKm;
+    auto *minlonAttr = bounds->first_attribute("minlon");
+    float minlon = strtof(minlonAttr->value(), nullptr) * lonToKm;
+    auto *maxlatAttr = bounds->first_attribute("maxlat");
+    float maxlat = strtof(maxlatAttr->value(), nullptr) * latToKm;
+    auto *maxlonAttr = bounds->first_attribute("maxlon");
+    float maxlon = strtof(maxlonAttr->value(), nullptr) * lonToKm;
+
+    // Parse nodes
+    for (auto *node = osm->first_node("node"); node; node = node->next_sibling("node")) {
+        auto node_id = strtoll(node->first_attribute("id")->value(), nullptr, 10);
+        nodes[node_id] = node;
+    }
+
+    std::vector<struct way> ways;
+    // Parse ways
+    for (auto *way = osm->first_node("way"); way; way = way->next_sibling("way")) {
+        struct way wayStruct;
+        bool isHighway = false;
+        char *highwayType;
+        size_t highwayTypeLen;
+        for (auto *tag = way->first_node("tag"); tag; tag = tag->next_sibling("tag")) {
+            if (strncmp(tag->first_attribute("k")->value(), "highway", tag->first_attribute("k")->value_size()) != 0)
+                continue;
+            isHighway = true;
+            highwayType = tag->first_attribute("v")->value();
+            highwayTypeLen = tag->first_attribute("v")->value_size();
+        }
+        if (!isHighway) continue;
+
+        if (strncmp(highwayType, "primary", highwayTypeLen) != 0 &&
+            strncmp(highwayType, "secondary", highwayTypeLen) != 0 &&
+            strncmp(highwayType, "tertiary", highwayTypeLen) != 0 &&
+            strncmp(highwayType, "residential", highwayTypeLen) != 0 &&
+            strncmp(highwayType, "service", highwayTypeLen) != 0)
+            continue;
+
+        for (auto *nd = way->first_node("nd"); nd; nd = nd->next_sibling("nd")) {
+            auto ref = strtoll(nd->first_attribute("ref")->value(), nullptr, 10);
+            wayStruct.nodes.push_back(ref);
+        }
+        ways.emplace_back(wayStruct);
+    }
+
+    std::vector<std::pair<float, float>> indexedNodes;
+    std::vector<std::pair<int, int>> edges;
+    int index = 0;
+    std::map<long long, int> nodeMapping;
+
+    for (auto &way: ways) {
+        int prev = -1;
+        for (auto nd: way.nodes) {
+            if (nodeMapping.find(nd) == nodeMapping.end()) {
+                nodeMapping[nd] = index++;
+                indexedNodes.emplace_back(
+                        std::make_pair(strtof(nodes[nd]->first_attribute("lat")->value(), nullptr) * latToKm,
+                                       strtof(nodes[nd]->first_attribute("lon")->value(), nullptr) * lonToKm));
+            }
+            int curr = nodeMapping[nd];
+            if (prev >= 0) {
+                edges.emplace_back(std::make_pair(prev, curr));
+            }
+            prev = curr;
+        }
+    }
+
+    if (!indexedNodes.empty()) { // The condition is only to prevent crashes on errornous maps
+        // Compute better bounds
+        minlat = maxlat = indexedNodes[0].first;
+        minlon = maxlon = indexedNodes[0].second;
+
+        for (const auto &node: indexedNodes) {
+            if (minlat > node.first) minlat = node.first;
+            if (maxlat < node.first) maxlat = node.first;
+            if (minlon > node.second) minlon = node.second;
+            if (maxlon < node.second) maxlon = node.second;
+        }
+    }
+
+    return {
+            .bounds = {minlat, minlon, maxlat, maxlon},
+            .nodes = indexedNodes,
+            .edges = edges
+    };
+}
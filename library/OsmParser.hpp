@@ -0,0 +1,21 @@
+#ifndef CHASE_SIMULATOR_OSMPARSER_HPP
+#define CHASE_SIMULATOR_OSMPARSER_HPP
+
+#include <utility>
+#include <vector>
+
+struct way {
+    std::vector<long long> nodes;
+    char type[32] = {0};
+};
+
+typedef struct parsedOsm {
+    float bounds[4];
+    std::vector<std::pair<float, float>> nodes;
+    std::vector<std::pair<int, int>> edges;
+} ParsedOsm;
+
+// Reads the primary, secondary, tertiary, residential and service streets of an OSM file, coordinates are in km
+ParsedOsm parseOsm(const char *filename);
+
+#endif //CHASE_SIMULATOR_OSMPARSER_HPP
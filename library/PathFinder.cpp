@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "PathFinder.hpp"
+#include "Profiler.hpp"
+
+using namespace watchman::simulator;
+
+static inline float euclidean(position_t p1, position_t p2) {
+    return sqrtf((p1.first - p2.first) * (p1.first - p2.first) + (p1.second - p2.second) * (p1.second - p2.second));
+}
+
+float PathFinder::shortest_path(const StreetMap &streetMap, std::deque<int> &path, int src, int dest) {
+    PROFILE_SCOPE(phase_path_finder);
+    const graph_t &graph = streetMap.graph;
+    size_t n = num_vertices(graph);
+    if (visited.size() != n) {
+        distances.assign(n, 0);
+        predecessors.assign(n, 0);
+        visited.assign(n, 0);
+        search = 0;
+    }
+    if (++search == 0) {
+        // The search counter wrapped around, old stamps would be mistaken for the current search
+        std::fill(visited.begin(), visited.end(), 0);
+        search = 1;
+    }
+
+    auto positions = get(vertex_position, graph);
+    auto weights = get(edge_weight, graph);
+    position_t goal = positions[dest];
+
+    queue.clear();
+    distances[src] = 0;
+    predecessors[src] = src;
+    visited[src] = search;
+    queue.emplace_back(euclidean(positions[src], goal), src);
+
+    bool found = false;
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<>());
+        auto [estimate, v] = queue.back();
+        queue.pop_back();
+        if (v == dest) {
+            found = true;
+            break;
+        }
+        float d = distances[v];
+        if (estimate > d + euclidean(positions[v], goal)) continue; // Outdated queue entry
+
+        for (auto [e, end] = out_edges(v, graph); e != end; ++e) {
+            int u = (int) target(*e, graph);
+            float du = d + weights[*e];
+            if (visited[u] == search && du >= distances[u]) continue;
+            distances[u] = du;
+            predecessors[u] = v;
+            visited[u] = search;
+            queue.emplace_back(du + euclidean(positions[u], goal), u);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>());
+        }
+    }
+    if (!found || src == dest) return 0;
+
+    for (int current = dest; current != src; current = predecessors[current]) {
+        path.push_front(current);
+    }
+    return distances[dest];
+}
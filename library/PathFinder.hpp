@@ -0,0 +1,27 @@
+#ifndef CHASE_SIMULATOR_PATHFINDER_HPP
+#define CHASE_SIMULATOR_PATHFINDER_HPP
+
+#include <deque>
+#include <utility>
+#include <vector>
+#include "StreetMap.hpp"
+
+namespace watchman::simulator {
+
+    // Point-to-point shortest paths using A* with the euclidean distance to the destination as heuristic. The edge
+    // weights are the euclidean edge lengths, so the heuristic never overestimates. The scratch buffers are kept
+    // between queries, a finder must not be used by multiple threads at once.
+    class PathFinder {
+        std::vector<float> distances;
+        std::vector<int> predecessors;
+        std::vector<unsigned> visited; // Search in which the distance and predecessor of a vertex were set
+        std::vector<std::pair<float, int>> queue;
+        unsigned search = 0;
+
+    public:
+        // Same result as StreetMap::shortest_path: the path excludes src and is empty if dest is not reachable
+        float shortest_path(const StreetMap &streetMap, std::deque<int> &path, int src, int dest);
+    };
+}
+
+#endif //CHASE_SIMULATOR_PATHFINDER_HPP
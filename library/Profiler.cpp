@@ -0,0 +1,135 @@
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Profiler.hpp"
+
+using namespace watchman::simulator;
+
+namespace {
+    const char *phaseNames[profiler::phase_count] = {
+            "parse", "build_graph", "build_hierarchy", "strategy_init", "neighbourhoods", "set_attacker", "tick",
+            "trajectory", "reach", "reach_job", "strategy_run", "metrics", "dijkstra", "shortest_path", "path_finder"
+    };
+    const char *counterNames[profiler::counter_count] = {
+            "runs", "ticks", "detections", "dijkstra_cache_hits", "hierarchy_queries"
+    };
+
+    struct TraceEvent {
+        profiler::phase_t phase;
+        profiler::clock::time_point start, end;
+    };
+
+    struct ThreadData {
+        int thread;
+        uint64_t calls[profiler::phase_count] = {0};
+        uint64_t nanoseconds[profiler::phase_count] = {0};
+        int64_t counters[profiler::counter_count] = {0};
+        std::vector<TraceEvent> trace;
+        uint64_t droppedEvents = 0;
+    };
+
+    // The data of finished threads is kept until the end, so the pool threads and the main thread add up
+    std::mutex registryLock;
+    std::vector<std::unique_ptr<ThreadData>> registry;
+    const profiler::clock::time_point origin = profiler::clock::now();
+    std::atomic<size_t> maxTraceEvents{0};
+
+    ThreadData &threadData() {
+        static thread_local ThreadData *data = nullptr;
+        if (!data) {
+            std::unique_lock<std::mutex> lock(registryLock);
+            registry.push_back(std::make_unique<ThreadData>());
+            data = registry.back().get();
+            data->thread = (int) registry.size();
+        }
+        return *data;
+    }
+}
+
+void profiler::record(phase_t phase, clock::time_point start, clock::time_point end) {
+    auto &data = threadData();
+    data.calls[phase]++;
+    data.nanoseconds[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    size_t maxEvents = maxTraceEvents.load(std::memory_order_relaxed);
+    if (maxEvents) {
+        if (data.trace.size() < maxEvents) data.trace.push_back({phase, start, end});
+        else data.droppedEvents++;
+    }
+}
+
+void profiler::count(counter_t counter, int64_t n) {
+    threadData().counters[counter] += n;
+}
+
+void profiler::enableTrace(size_t maxEvents) {
+    maxTraceEvents = maxEvents;
+}
+
+void profiler::report(std::ostream &out) {
+    if (!enabled()) {
+        out << "Profiling is not available, build with -DPROFILING=ON" << std::endl;
+        return;
+    }
+
+    uint64_t calls[phase_count] = {0}, nanoseconds[phase_count] = {0};
+    int64_t counters[counter_count] = {0};
+    uint64_t droppedEvents = 0;
+    {
+        std::unique_lock<std::mutex> lock(registryLock);
+        for (const auto &data: registry) {
+            for (int i = 0; i < phase_count; i++) {
+                calls[i] += data->calls[i];
+                nanoseconds[i] += data->nanoseconds[i];
+            }
+            for (int i = 0; i < counter_count; i++) counters[i] += data->counters[i];
+            droppedEvents += data->droppedEvents;
+        }
+    }
+
+    // The phases of all threads are added up, so parallel phases can exceed the wall time
+    double wall = std::chrono::duration<double, std::milli>(clock::now() - origin).count();
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "Profile after " << wall << " ms, nested phases are included in their parents" << std::endl;
+    out << std::left << std::setw(20) << "phase" << std::right << std::setw(12) << "calls" << std::setw(14) << "total ms"
+        << std::setw(14) << "mean us" << std::setw(10) << "% wall" << std::endl;
+    for (int i = 0; i < phase_count; i++) {
+        if (!calls[i]) continue;
+        double total = (double) nanoseconds[i] / 1e6;
+        out << std::left << std::setw(20) << phaseNames[i] << std::right << std::setw(12) << calls[i]
+            << std::setw(14) << total << std::setw(14) << total * 1e3 / (double) calls[i]
+            << std::setw(10) << std::setprecision(1) << 100 * total / wall << std::setprecision(3) << std::endl;
+    }
+    for (int i = 0; i < counter_count; i++) {
+        if (counters[i]) out << std::left << std::setw(20) << counterNames[i] << std::right << std::setw(12) << counters[i] << std::endl;
+    }
+    if (droppedEvents) out << "Trace events dropped: " << droppedEvents << std::endl;
+    out.flags(flags);
+}
+
+bool profiler::writeTrace(const std::string &file) {
+    std::ofstream out(file);
+    if (!out) return false;
+
+    std::unique_lock<std::mutex> lock(registryLock);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &data: registry) {
+        for (const auto &event: data->trace) {
+            // Timestamps and durations are in microseconds
+            auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(event.start - origin).count();
+            auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(event.end - event.start).count();
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << phaseNames[event.phase] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << data->thread << ",\"ts\":" << start / 1000 << "." << std::setw(3) << std::setfill('0') << start % 1000
+                << ",\"dur\":" << duration / 1000 << "." << std::setw(3) << duration % 1000 << std::setfill(' ') << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return (bool) out;
+}
@@ -0,0 +1,84 @@
+#ifndef CHASE_SIMULATOR_PROFILER_HPP
+#define CHASE_SIMULATOR_PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Scoped timers and counters of the hot paths. They are only compiled in with -DPROFILING=ON, otherwise the macros
+// expand to nothing. Every thread accumulates into its own buffers, the report merges them.
+namespace watchman::simulator::profiler {
+    // Phases can be nested, their times are inclusive
+    typedef enum {
+        phase_parse,
+        phase_build_graph,
+        phase_build_hierarchy,
+        phase_strategy_init,
+        phase_neighbourhoods,
+        phase_set_attacker,
+        phase_tick,
+        phase_trajectory,
+        phase_reach,
+        phase_reach_job,
+        phase_strategy_run,
+        phase_metrics,
+        phase_dijkstra,
+        phase_shortest_path,
+        phase_path_finder,
+        phase_count
+    } phase_t;
+
+    typedef enum {
+        counter_runs,
+        counter_ticks,
+        counter_detections,
+        counter_dijkstra_cache_hits,
+        counter_hierarchy_queries,
+        counter_count
+    } counter_t;
+
+    typedef std::chrono::steady_clock clock;
+
+    constexpr bool enabled() {
+#ifdef PROFILING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void record(phase_t phase, clock::time_point start, clock::time_point end);
+    void count(counter_t counter, int64_t n);
+
+    // Phases are kept as trace events from now on, at most maxEvents per thread
+    void enableTrace(size_t maxEvents = 1 << 22);
+
+    // Neither may be called while other threads are profiled
+    void report(std::ostream &out);
+    bool writeTrace(const std::string &file); // Chrome trace event format, e.g. for chrome://tracing or Perfetto
+
+    class ScopedTimer {
+        phase_t phase;
+        clock::time_point start;
+    public:
+        explicit ScopedTimer(phase_t phase) : phase(phase), start(clock::now()) {};
+        ~ScopedTimer() { record(phase, start, clock::now()); };
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILING
+#define PROFILE_SCOPE(phase) \
+    watchman::simulator::profiler::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(watchman::simulator::profiler::phase)
+#define PROFILE_COUNT(counter, n) watchman::simulator::profiler::count(watchman::simulator::profiler::counter, n)
+#else
+#define PROFILE_SCOPE(phase) ((void) 0)
+#define PROFILE_COUNT(counter, n) ((void) 0)
+#endif
+
+#endif //CHASE_SIMULATOR_PROFILER_HPP
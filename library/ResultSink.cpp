@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include "Aggregation.hpp"
+#include "ResultSink.hpp"
+
+namespace {
+    const uint32_t ROW_GROUP_MAGIC = 0x47524843; // "CHRG"
+    const uint32_t ROW_GROUP_VERSION = 1;
+
+    typedef enum {
+        column_float = 0,
+        column_int = 1,
+        column_string = 2,
+        column_nullable = 0x80
+    } column_type_t;
+
+    const char *parameterNames[parameter_count] = {
+            "static_distance", "radius_time", "radius_distance", "ser_distance", "sgr_distance", "ksn_k", "ksn_max_dist",
+            "random_radius_time", "random_radius_distance", "random_radius_fraction", "random_streetdistance_time",
+            "random_streetdistance_distance", "random_streetdistance_fraction"
+    };
+    const bool integerParameters[parameter_count] = {
+            false, true, false, false, false, true, false, true, false, false, true, false, false
+    };
+    const char *metricNames[metric_count] = {
+            "activity", "detection", "last_tracking", "path_matching", "path_target_diff", "path_length_diff"
+    };
+
+    void appendInteger(std::string &out, int value) {
+        char text[16];
+        int length = snprintf(text, sizeof(text), "%d", value);
+        out.append(text, length);
+    }
+
+    template<typename T>
+    void appendRaw(std::string &out, T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    // Writes the column header, the data length is patched by endColumn
+    size_t beginColumn(std::string &out, uint8_t type, const char *name) {
+        appendRaw<uint8_t>(out, type);
+        auto nameLength = (uint8_t) strlen(name);
+        appendRaw<uint8_t>(out, nameLength);
+        out.append(name, nameLength);
+        appendRaw<uint32_t>(out, 0);
+        return out.size();
+    }
+
+    void endColumn(std::string &out, size_t dataStart) {
+        auto length = (uint32_t) (out.size() - dataStart);
+        memcpy(&out[dataStart - sizeof(uint32_t)], &length, sizeof(uint32_t));
+    }
+
+    template<typename Value>
+    void appendStringColumn(std::string &out, const char *name, const std::vector<RunResult> &results, Value value) {
+        size_t start = beginColumn(out, column_string, name);
+        std::unordered_map<std::string, uint32_t> dictionary;
+        std::vector<const std::string *> entries;
+        std::vector<uint32_t> codes;
+        for (const auto &result: results) {
+            auto inserted = dictionary.emplace(value(result), (uint32_t) entries.size());
+            if (inserted.second) entries.push_back(&inserted.first->first);
+            codes.push_back(inserted.first->second);
+        }
+        appendRaw<uint32_t>(out, (uint32_t) entries.size());
+        for (const auto *entry: entries) {
+            auto length = (uint8_t) std::min<size_t>(entry->size(), 255);
+            appendRaw<uint8_t>(out, length);
+            out.append(entry->data(), length);
+        }
+        out.append(reinterpret_cast<const char *>(codes.data()), codes.size() * sizeof(uint32_t));
+        endColumn(out, start);
+    }
+}
+
+std::string RunResult::configurationKey() const {
+    std::string key = map;
+    key += '\0';
+    key += strategy;
+    key += '\0';
+    appendRaw(key, routerCount);
+    appendRaw(key, txProb);
+    appendRaw(key, parameterMask);
+    for (int i = 0; i < parameter_count; i++) {
+        if (parameterMask & (1u << i)) appendRaw(key, parameters[i]);
+    }
+    return key;
+}
+
+bool parseMetric(const std::string &name, metric_t &metric) {
+    for (int i = 0; i < metric_count; i++) {
+        if (name == metricNames[i]) {
+            metric = (metric_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+ResultSink::ResultSink(const std::string &fileName) : file(fileName, std::ofstream::app | std::ofstream::binary) {
+}
+
+void ResultSink::write(const std::string &data) {
+    std::unique_lock<std::mutex> lock(fileLock);
+    file.write(data.data(), (std::streamsize) data.size());
+    file.flush();
+}
+
+void ResultSink::append(const std::vector<RunResult> &results, std::string &buffer) {
+    if (results.empty()) return;
+    buffer.clear();
+    encode(results, buffer);
+    write(buffer);
+}
+
+std::unique_ptr<ResultSink> ResultSink::open(const std::string &format, const std::string &fileName) {
+    if (format == "csv") return std::make_unique<CsvResultSink>(fileName);
+    if (format == "columnar") return std::make_unique<ColumnarResultSink>(fileName);
+    if (format == "summary") return std::make_unique<AggregateResultSink>(fileName);
+    return nullptr;
+}
+
+void CsvResultSink::appendNumber(std::string &out, float value) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%g", value); // Same as the default formatting of streams
+    out.append(text, length);
+}
+
+void CsvResultSink::appendKey(std::string &out, const RunResult &result) {
+    out += result.map;
+    out += ',';
+    appendInteger(out, result.routerCount);
+    out += ',';
+    appendNumber(out, result.txProb);
+    out += ',';
+    out += result.strategy;
+    out += ',';
+    for (int i = 0; i < parameter_count; i++) {
+        if (result.parameterMask & (1u << i)) {
+            if (integerParameters[i]) appendInteger(out, (int) result.parameters[i]);
+            else appendNumber(out, result.parameters[i]);
+        }
+        out += ',';
+    }
+}
+
+void CsvResultSink::encode(const std::vector<RunResult> &results, std::string &out) const {
+    for (const auto &result: results) {
+        appendKey(out, result);
+        for (int i = 0; i < metric_count; i++) {
+            appendNumber(out, result.metrics[i]);
+            out += i + 1 < metric_count ? ',' : '\n';
+        }
+    }
+}
+
+void ColumnarResultSink::encode(const std::vector<RunResult> &results, std::string &out) const {
+    auto rows = (uint32_t) results.size();
+    appendRaw<uint32_t>(out, ROW_GROUP_MAGIC);
+    appendRaw<uint32_t>(out, ROW_GROUP_VERSION);
+    appendRaw<uint32_t>(out, rows);
+    appendRaw<uint32_t>(out, 4 + parameter_count + metric_count);
+
+    appendStringColumn(out, "map", results, [](const RunResult &result) { return result.map; });
+
+    size_t start = beginColumn(out, column_int, "routers");
+    for (const auto &result: results) appendRaw<int32_t>(out, result.routerCount);
+    endColumn(out, start);
+
+    start = beginColumn(out, column_float, "tx_prob");
+    for (const auto &result: results) appendRaw<float>(out, result.txProb);
+    endColumn(out, start);
+
+    appendStringColumn(out, "strategy", results, [](const RunResult &result) { return std::string(result.strategy); });
+
+    std::vector<uint8_t> validity((rows + 7) / 8);
+    for (int i = 0; i < parameter_count; i++) {
+        start = beginColumn(out, (integerParameters[i] ? column_int : column_float) | column_nullable, parameterNames[i]);
+        std::fill(validity.begin(), validity.end(), 0);
+        for (uint32_t row = 0; row < rows; row++) {
+            if (results[row].parameterMask & (1u << i)) validity[row / 8] |= 1 << (row % 8);
+        }
+        out.append(reinterpret_cast<const char *>(validity.data()), validity.size());
+        for (const auto &result: results) {
+            if (integerParameters[i]) appendRaw<int32_t>(out, (int32_t) result.parameters[i]);
+            else appendRaw<float>(out, result.parameters[i]);
+        }
+        endColumn(out, start);
+    }
+
+    for (int i = 0; i < metric_count; i++) {
+        start = beginColumn(out, column_float, metricNames[i]);
+        for (const auto &result: results) appendRaw<float>(out, result.metrics[i]);
+        endColumn(out, start);
+    }
+}
+
+void ResultWriter::write(RunResult result) {
+    batch.emplace_back(std::move(result));
+    if (batch.size() >= batchSize) flush();
+}
+
+void ResultWriter::flush() {
+    sink.append(batch, buffer);
+    batch.clear();
+}
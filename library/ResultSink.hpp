@@ -0,0 +1,121 @@
+#ifndef CHASE_SIMULATOR_RESULTSINK_HPP
+#define CHASE_SIMULATOR_RESULTSINK_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Parameter columns of the strategies, a result only has the ones of its strategy
+typedef enum {
+    parameter_static_distance,
+    parameter_radius_time,
+    parameter_radius_distance,
+    parameter_ser_distance,
+    parameter_sgr_distance,
+    parameter_ksn_k,
+    parameter_ksn_max_dist,
+    parameter_random_radius_time,
+    parameter_random_radius_distance,
+    parameter_random_radius_fraction,
+    parameter_random_streetdistance_time,
+    parameter_random_streetdistance_distance,
+    parameter_random_streetdistance_fraction,
+    parameter_count
+} parameter_t;
+
+typedef enum {
+    metric_activity,
+    metric_detection,
+    metric_last_tracking,
+    metric_path_matching,
+    metric_path_target_diff,
+    metric_path_length_diff,
+    metric_count
+} metric_t;
+
+struct RunResult {
+    std::string map;
+    int routerCount = 0;
+    float txProb = 0;
+    const char *strategy = "";
+    float parameters[parameter_count] = {0};
+    uint32_t parameterMask = 0; // Bit i is set if parameter i belongs to the strategy
+    float metrics[metric_count] = {0};
+
+    void setParameter(parameter_t parameter, float value) {
+        parameters[parameter] = value;
+        parameterMask |= 1u << parameter;
+    }
+
+    // Equal for all runs of a configuration: map, router count, pTx, strategy and its parameters
+    [[nodiscard]] std::string configurationKey() const;
+};
+
+bool parseMetric(const std::string &name, metric_t &metric);
+
+// Destination of the evaluator results. Batches are encoded on the thread that submits them, only the write to the
+// file is serialized, so parallel runs do not wait for each other's formatting.
+class ResultSink {
+    std::ofstream file;
+    std::mutex fileLock;
+
+protected:
+    virtual void encode(const std::vector<RunResult> &results, std::string &out) const = 0;
+    void write(const std::string &data);
+
+public:
+    explicit ResultSink(const std::string &fileName);
+    virtual ~ResultSink() = default;
+
+    [[nodiscard]] bool good() const { return file.good(); };
+    virtual void append(const std::vector<RunResult> &results, std::string &buffer);
+    virtual void finish() {}; // Called once all writers are flushed
+
+    // "csv", "columnar" or "summary", nullptr for other formats
+    static std::unique_ptr<ResultSink> open(const std::string &format, const std::string &fileName);
+};
+
+// One line per result, the parameter columns of other strategies stay empty:
+//   map, routers, tx_prob, strategy, parameter_t columns, metric_t columns
+class CsvResultSink : public ResultSink {
+protected:
+    void encode(const std::vector<RunResult> &results, std::string &out) const override;
+public:
+    using ResultSink::ResultSink;
+
+    static void appendKey(std::string &out, const RunResult &result); // The columns up to the metrics
+    static void appendNumber(std::string &out, float value);
+};
+
+// Sequence of self-describing row groups, one per batch, so files can be appended to. All numbers are little endian.
+//   row group: uint32 magic "CHRG", uint32 version, uint32 rows, uint32 columns, columns
+//   column:    uint8 type, uint8 name length, name, uint32 data length, data
+//   types:     0 float32[rows], 1 int32[rows], 2 string dictionary: uint32 entries, (uint8 length, bytes) per entry,
+//              uint32 codes[rows]; with 0x80 set, a validity bitmap of (rows + 7) / 8 bytes precedes the values
+class ColumnarResultSink : public ResultSink {
+protected:
+    void encode(const std::vector<RunResult> &results, std::string &out) const override;
+public:
+    using ResultSink::ResultSink;
+};
+
+// Results of one thread, they are submitted to the sink in batches
+class ResultWriter {
+    ResultSink &sink;
+    size_t batchSize;
+    std::vector<RunResult> batch;
+    std::string buffer;
+public:
+    explicit ResultWriter(ResultSink &sink, size_t batchSize = 1024) : sink(sink), batchSize(batchSize) {};
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+    ~ResultWriter() { flush(); };
+
+    void write(RunResult result);
+    void flush();
+};
+
+#endif //CHASE_SIMULATOR_RESULTSINK_HPP
@@ -10,12 +10,12 @@ namespace watchman::simulator {
             int id;
             int index;
             edge_t edge;
+            int edgeId;
             float fraction;
             position_t position;
 
             float radius;
-            bool active;
-            int activeSince;
+            int activatedAt; // Tick of the last activation, the activity itself is kept in a RouterActivity
 
             [[nodiscard]] bool in_reach(position_t obj) const;
             [[nodiscard]] bool in_reach(position_t obj, float distance) const;
@@ -0,0 +1,26 @@
+#include <algorithm>
+
+#include "RouterActivity.hpp"
+
+using namespace watchman::simulator;
+
+void RouterActivity::resize(std::size_t n) {
+    words.resize((n + 63) / 64, 0);
+    // Bits beyond the size stay clear, so counting and iterating need no mask
+    if (n < routerCount && n % 64) words.back() &= (uint64_t(1) << (n % 64)) - 1;
+    routerCount = n;
+}
+
+void RouterActivity::clear() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+void RouterActivity::set(const std::vector<int> &indices) {
+    for (int i: indices) set(i);
+}
+
+std::size_t RouterActivity::count() const {
+    std::size_t active = 0;
+    for (auto word: words) active += __builtin_popcountll(word);
+    return active;
+}
@@ -0,0 +1,39 @@
+#ifndef CHASE_SIMULATOR_ROUTERACTIVITY_HPP
+#define CHASE_SIMULATOR_ROUTERACTIVITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace watchman::simulator {
+
+    // Which routers are active, as a dense bitset indexed by the router index. Clearing and counting work on whole
+    // words, so they cost the router count / 64 instead of the router count.
+    class RouterActivity {
+        std::vector<uint64_t> words;
+        std::size_t routerCount = 0;
+
+    public:
+        void resize(std::size_t n); // Keeps the state of the first n routers, added ones are inactive
+        void clear();
+
+        [[nodiscard]] std::size_t size() const { return routerCount; };
+        [[nodiscard]] bool test(std::size_t i) const { return i < routerCount && (words[i >> 6] >> (i & 63)) & 1; };
+        void set(std::size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); };
+        void reset(std::size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); };
+        void set(const std::vector<int> &indices); // Sparse union
+        [[nodiscard]] std::size_t count() const;
+
+        // Calls f(index) for every active router in ascending order
+        template<typename F>
+        void forEach(F f) const {
+            for (std::size_t w = 0; w < words.size(); w++) {
+                for (uint64_t word = words[w]; word; word &= word - 1) {
+                    f((int) (w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        };
+    };
+}
+
+#endif //CHASE_SIMULATOR_ROUTERACTIVITY_HPP
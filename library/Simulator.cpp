@@ -1,12 +1,20 @@
+#include <limits>
 #include <random>
 #include <thread>
 
+#include "Profiler.hpp"
 #include "Simulator.hpp"
 
 using namespace watchman::simulator;
 
-static std::default_random_engine generator;
-static std::uniform_real_distribution<float> float_distribution(0, 1);
+namespace {
+    uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+}
 
 Simulator::Simulator() : Simulator(0) {
     // And we directly re-seed the generator here
@@ -14,13 +22,34 @@ Simulator::Simulator() : Simulator(0) {
     generator.seed(rd());
 }
 
-Simulator::Simulator(const int seed) : tick(0), done(false), strategy(nullptr), clustering(nullptr), detectionEvents(),
-                                       concurrentReach(new ConcurrentReach()),
-                                       possibleDetectionEvents(), routerTicks(0), latestDetection(0), latestPossibleDetection(0) {
+Simulator::Simulator(const int seed) : Simulator(seed, nullptr, new ConcurrentReach(), std::make_shared<NeighborhoodCache>()) {
+    ownStreetMap = std::make_shared<StreetMap>();
+    streetMap = ownStreetMap;
+}
+
+Simulator::Simulator(const Simulator &scenario, const int seed)
+        : Simulator(seed, scenario.streetMap, new ConcurrentReach(nullptr), scenario.neighborhoods) {
+    // Shares the street map and copies the routers of the scenario. The reach is calculated on the calling thread, so
+    // that several of these simulators can run in parallel on the shared thread pool. The street map stays read only,
+    // building it is ignored until a full reset gives the fork its own.
+    routers = scenario.routers;
+}
+
+Simulator::Simulator(const int seed, std::shared_ptr<const StreetMap> p_streetMap, ConcurrentReach *p_concurrentReach,
+                     std::shared_ptr<NeighborhoodCache> p_neighborhoods)
+        : streetMap(std::move(p_streetMap)), neighborhoods(std::move(p_neighborhoods)), strategy(nullptr),
+          clustering(nullptr), concurrentReach(p_concurrentReach), tick(0), done(false), detectionEvents(),
+          possibleDetectionEvents(), routerTicks(0), latestDetection(0), latestPossibleDetection(0) {
     generator.seed(seed);
     this->seed = std::make_pair(true, seed);
 }
 
+Simulator::~Simulator() {
+    delete strategy;
+    delete clustering;
+    delete concurrentReach;
+}
+
 #ifdef DEBUG
 
 void printPath(std::deque<int> &path, int max = 5) {
@@ -36,69 +65,46 @@ void printPath(std::deque<int> &path, int max = 5) {
 
 void Simulator::doTick() {
     if (done) return;
+    PROFILE_SCOPE(phase_tick);
+    PROFILE_COUNT(counter_ticks, 1);
     tick++;
     events.clear();
 
-    if (precalculationIndex < 0 || precalculationIndex >= precalculatedPositions.size()) {
-        if (precalculationDone) {
+    // A follower takes the tick the leader just calculated
+    const Simulator &source = leader ? *leader : *this;
+    int index;
+    if (leader) {
+        if (leader->done) {
             done = true;
             return;
         }
+        index = leader->precalculationIndex - 1;
+    } else {
+        if (precalculationIndex < 0 || precalculationIndex >= precalculatedPositions.size()) {
+            if (precalculationDone) {
+                done = true;
+                return;
+            }
 
-        precalculationIndex = 0;
-#ifdef DEBUG
-        std::cout << "Clearing positions" << std::endl;
-#endif
-        precalculatedPositions.clear();
-        precalculatedGraphPositions.clear();
-        precalculatedReach.clear();
-
-        for (int i = 0; i < maxPrecalculations; i++) {
-            // Move attacker
-            float distance = attacker.speed;
-            while (distance > 0 && !precalculationDone) {
-                float edge_length = streetMap.get_edge_length(attacker.edge);
-                bool walk_forwards = path.front() == attacker.edge.second;
-                float remaining_fraction = walk_forwards ? 1 - attacker.fraction : attacker.fraction;
-
-                if (remaining_fraction * edge_length > distance) {
-                    // We stay on this edge
-                    attacker.fraction = walk_forwards ? attacker.fraction + distance / edge_length : attacker.fraction -
-                                                                                                     distance /
-                                                                                                     edge_length;
-                    distance = 0;
-                } else {
-                    // We move to the next edge
-                    distance -= remaining_fraction * edge_length;
-                    int curr = path.front();
-                    path.pop_front();
-                    if (path.empty()) {
-                        // We are done
-                        precalculationDone = true;
-                        attacker.fraction = 1;
-                        break;
-                    }
-                    int next = path.front();
-                    if (curr < next) {
-                        attacker.edge = std::make_pair(curr, next);
-                        attacker.fraction = 0;
-                    } else {
-                        attacker.edge = std::make_pair(next, curr);
-                        attacker.fraction = 1;
-                    }
-                }
+            precalculationIndex = 0;
+            {
+                PROFILE_SCOPE(phase_trajectory);
+                precalculateTrajectory();
+            }
+            if (!clustering) {
+                clustering = new Clustering(routers);
+                concurrentReach->setClustering(clustering);
             }
-            attacker.position = streetMap.get_position(attacker.edge, attacker.fraction);
-            precalculatedPositions.push_back(attacker.position);
-            precalculatedGraphPositions.emplace_back(std::make_pair(attacker.edge, attacker.fraction));
-            if (precalculationDone) break;
+            precalculatedReach = concurrentReach->precalculate(precalculatedPositions);
         }
-        precalculatedReach = concurrentReach->precalculate(precalculatedPositions);
+        index = precalculationIndex++;
     }
 
-    attacker.edge = precalculatedGraphPositions[precalculationIndex].first;
-    attacker.fraction = precalculatedGraphPositions[precalculationIndex].second;
-    attacker.position = precalculatedPositions[precalculationIndex];
+    int segment = source.precalculatedSegments[index];
+    attacker.edge = source.segmentEdges[segment];
+    attacker.edgeId = source.segmentEdgeIds[segment];
+    attacker.fraction = source.precalculatedFractions[index];
+    attacker.position = source.precalculatedPositions[index];
 
 #ifdef DEBUG
     //    std::cout << "tick=" << tick << " edge=(" << attacker.edge.first << "," << attacker.edge.second << ") fraction="
@@ -106,21 +112,21 @@ void Simulator::doTick() {
     //              << std::endl;
 #endif
 
-    for (auto router: routers) {
-        if (router.active) {
 #ifdef DEBUG
-            std::cout << "Router active id=" << router.index << std::endl;
+    activity.forEach([](int index) { std::cout << "Router active id=" << index << std::endl; });
 #endif
-            routerTicks++;
-        }
-    }
+    routerTicks += (int) activity.count();
 
-    float r = random_float();
-    if (attacker.transmission_prob > r) {
+    if (leader) {
+        transmission = leader->transmission;
+    } else {
+        transmission = transmissionKey.first ? transmits(tick) : attacker.transmission_prob > random_float();
+    }
+    if (transmission) {
         // The attacker sends a packet
         edge_t *detection = nullptr;
-        for (auto &router: precalculatedReach[precalculationIndex]) { // Note router in precalculatedReach is not synced with routers
-            if (routers[router.index].active) {
+        for (auto &router: source.precalculatedReach[index]) { // Note router in precalculatedReach is not synced with routers
+            if (activity.test(router.index)) {
                 events.push_back({router_detects, tick, routers[router.index]});
                 detectionEvents[router.index] = true;
                 latestDetection = tick;
@@ -133,23 +139,19 @@ void Simulator::doTick() {
             latestPossibleDetection = tick;
         }
         if (detection) {
+            PROFILE_COUNT(counter_detections, 1);
             detectionPoints.push_back(*detection);
         }
     } else {
         // The attacker does not send a packet
-        for (auto router: precalculatedReach[precalculationIndex]) {
+        for (auto router: source.precalculatedReach[index]) {
             possibleDetectionEvents[router.index] = true;
             latestPossibleDetection = tick;
         }
     }
-    precalculationIndex++;
 
-    for (auto &router: routers) { // todo move to strategy
-        if (router.active) {
-            router.activeSince++;
-        }
-    }
     if (strategy) {
+        PROFILE_SCOPE(phase_strategy_run);
         strategy->run();
     }
 }
@@ -170,8 +172,11 @@ void Simulator::reset() {
 #ifdef DEBUG
     std::cout << "Clearing positions" << std::endl;
 #endif
-    precalculatedGraphPositions.clear();
+    precalculatedSegments.clear();
+    precalculatedFractions.clear();
     precalculatedReach.clear();
+    trajectoryTicks = 0;
+    trajectorySegment = 0;
 
     done = false;
     tick = 0;
@@ -183,20 +188,27 @@ void Simulator::halfReset() {
     strategy = nullptr;
     if (seed.first) generator.seed(seed.second);
     routers.clear();
+    activity.resize(0);
+    invalidateNeighborhoods();
 }
 
 void Simulator::fullReset() {
     this->halfReset();
-    streetMap = StreetMap();
+    ownStreetMap = std::make_shared<StreetMap>();
+    streetMap = ownStreetMap;
 }
 
 void Simulator::setStrategy(Strategy *p_strategy) {
+    PROFILE_SCOPE(phase_strategy_init);
     delete strategy;
     delete clustering;
+    clustering = nullptr; // Built with the first reach precalculation, followers need none
     strategy = p_strategy;
-    strategy->init(routers, events, streetMap);
-    clustering = new Clustering(routers);
-    concurrentReach->setClustering(clustering);
+    strategy->init(routers, activity, events, tick, *streetMap, *neighborhoods);
+}
+
+void Simulator::follow(const Simulator *p_leader) {
+    leader = p_leader;
 }
 
 int Simulator::getTick() const {
@@ -208,34 +220,210 @@ bool Simulator::isDone() const {
 }
 
 void Simulator::addVertex(int vertex, float x, float y) {
-    streetMap.add_vertex(vertex, std::make_pair(x, y));
+    if (!ownStreetMap) return;
+    ownStreetMap->add_vertex(vertex, std::make_pair(x, y));
 }
 
 void Simulator::addEdge(int v1, int v2) {
+    if (!ownStreetMap) return;
     if (v1 > v2) std::swap(v1, v2);
-    streetMap.add_edge(v1, v2);
+    ownStreetMap->add_edge(v1, v2);
+}
+
+void Simulator::addVertices(const float *xy, int n) {
+    if (!ownStreetMap) return;
+    std::vector<position_t> positions(n);
+    for (int i = 0; i < n; i++) {
+        positions[i] = std::make_pair(xy[2 * i], xy[2 * i + 1]);
+    }
+    ownStreetMap->add_vertices(positions.data(), positions.size());
+}
+
+void Simulator::addEdges(const int *pairs, int m) {
+    if (!ownStreetMap) return;
+    std::vector<edge_t> edges(m);
+    for (int i = 0; i < m; i++) {
+        edges[i] = std::make_pair(pairs[2 * i], pairs[2 * i + 1]);
+    }
+    ownStreetMap->add_edges(edges.data(), edges.size());
 }
 
 void Simulator::buildGraph() {
-    streetMap.build_graph();
+    if (!ownStreetMap) return;
+    ownStreetMap->build_graph();
+    resolveRouterEdges();
+}
+
+void Simulator::buildGraph(const std::vector<position_t> &vertices, const std::vector<edge_t> &edges) {
+    if (!ownStreetMap) return;
+    ownStreetMap->build_graph(vertices, edges);
+    resolveRouterEdges();
+}
+
+void Simulator::buildHierarchy(const std::string &cacheFile) {
+    if (!ownStreetMap) return;
+    // A cached hierarchy is only used if it was built for the same graph
+    if (!cacheFile.empty() && ownStreetMap->load_hierarchy(cacheFile)) return;
+    ownStreetMap->build_hierarchy();
+    if (!cacheFile.empty()) ownStreetMap->save_hierarchy(cacheFile);
+}
+
+void Simulator::resolveRouterEdges() {
+    // Routers can be added before the graph is built, the edge ids are only known afterwards. Routers whose edge the
+    // graph does not have are dropped, everything indexed by edge id relies on valid ids.
+    std::vector<Router> resolved;
+    for (auto &router: routers) {
+        router.edgeId = streetMap->get_edge_id(router.edge);
+        if (router.edgeId < 0) continue;
+        router.index = (int) resolved.size();
+        router.position = streetMap->get_position(router.edge, router.fraction);
+        resolved.push_back(router);
+    }
+    routers = std::move(resolved);
+    activity.resize(routers.size());
+    invalidateNeighborhoods();
+}
+
+void Simulator::invalidateNeighborhoods() {
+    // Forks keep the cache of their routers
+    if (neighborhoods.use_count() > 1 || !neighborhoods->empty()) neighborhoods = std::make_shared<NeighborhoodCache>();
+}
+
+void Simulator::buildTrajectory() {
+    segmentEdges.clear();
+    segmentEdgeIds.clear();
+    segmentStart.clear();
+    segmentEnd.clear();
+    segmentLength.clear();
+    segmentFraction.clear();
+    segmentDirection.clear();
+    trajectoryTicks = 0;
+    trajectorySegment = 0;
+
+    // The first segment leads from the start on the attacker's edge to path[0], the others follow the path
+    double walked = 0;
+    for (int k = 0; k < path.size(); k++) {
+        edge_t edge;
+        float fraction, direction;
+        if (k == 0) {
+            edge = attacker.edge;
+            direction = path[0] == edge.second ? 1 : -1;
+            fraction = attacker.fraction;
+        } else if (path[k - 1] < path[k]) {
+            edge = std::make_pair(path[k - 1], path[k]);
+            direction = 1;
+            fraction = 0;
+        } else {
+            edge = std::make_pair(path[k], path[k - 1]);
+            direction = -1;
+            fraction = 1;
+        }
+        int id = k == 0 ? attacker.edgeId : streetMap->get_edge_id(edge);
+        float length = streetMap->get_edge_length(id);
+        float remaining = direction > 0 ? 1 - fraction : fraction;
+
+        segmentEdges.push_back(edge);
+        segmentEdgeIds.push_back(id);
+        segmentStart.push_back(walked);
+        walked += remaining * length;
+        segmentEnd.push_back(walked);
+        segmentLength.push_back(length);
+        segmentFraction.push_back(fraction);
+        segmentDirection.push_back(direction);
+    }
+
+    auto count = segmentEdges.size();
+    segmentX.resize(count);
+    segmentY.resize(count);
+    segmentDX.resize(count);
+    segmentDY.resize(count);
+    for (int k = 0; k < count; k++) {
+        auto p1 = streetMap->get_position(segmentEdges[k].first), p2 = streetMap->get_position(segmentEdges[k].second);
+        segmentX[k] = p1.first;
+        segmentY[k] = p1.second;
+        segmentDX[k] = p2.first - p1.first;
+        segmentDY[k] = p2.second - p1.second;
+    }
+}
+
+void Simulator::precalculateTrajectory() {
+    // The attacker walked i * speed after tick i, a merge against the segment ends yields its segment
+    precalculatedSegments.clear();
+    precalculatedFractions.clear();
+    int segmentCount = (int) segmentEdges.size();
+    for (int i = 0; i < maxPrecalculations; i++) {
+        double walked = (double) ++trajectoryTicks * attacker.speed;
+        while (trajectorySegment < segmentCount && segmentEnd[trajectorySegment] <= walked) trajectorySegment++;
+        if (trajectorySegment == segmentCount) {
+            // The attacker arrived, it stays at the end of the last edge
+            precalculationDone = true;
+            if (segmentCount == 0) {
+                segmentEdges.push_back(attacker.edge);
+                segmentEdgeIds.push_back(attacker.edgeId);
+                auto p1 = streetMap->get_position(attacker.edge.first);
+                auto p2 = streetMap->get_position(attacker.edge.second);
+                segmentX.push_back(p1.first);
+                segmentY.push_back(p1.second);
+                segmentDX.push_back(p2.first - p1.first);
+                segmentDY.push_back(p2.second - p1.second);
+            }
+            precalculatedSegments.push_back(std::max(segmentCount - 1, 0));
+            precalculatedFractions.push_back(1);
+            break;
+        }
+        int k = trajectorySegment;
+        precalculatedSegments.push_back(k);
+        precalculatedFractions.push_back(
+                segmentFraction[k] + segmentDirection[k] * (float) (walked - segmentStart[k]) / segmentLength[k]);
+    }
+
+    // Interpolation over plain arrays. The segment values are gathered per tick and the positions stay pairs, because
+    // ConcurrentReach and the attacker take position_t, so this vectorizes only partially
+    auto n = precalculatedSegments.size();
+    const int *segments = precalculatedSegments.data();
+    const float *fractions = precalculatedFractions.data();
+    precalculatedPositions.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        int k = segments[i];
+        precalculatedPositions[i] = std::make_pair(segmentX[k] + segmentDX[k] * fractions[i],
+                                                   segmentY[k] + segmentDY[k] * fractions[i]);
+    }
 }
 
 bool
 Simulator::setAttacker(int v1, int v2, int target, float fraction, float speed, float tx_prob, int alpha_router_index,
                        float min_path_length) {
+    PROFILE_SCOPE(phase_set_attacker);
+    lastAttackerSetup = {v1, v2, target, fraction, speed, tx_prob, alpha_router_index};
     attacker.edge = std::make_pair(v1, v2);
+    attacker.edgeId = streetMap->get_edge_id(attacker.edge);
+    bool validTarget = target >= 0 && (size_t) target < streetMap->count_vertices();
+    bool validAlpha = !strategy || (alpha_router_index >= 0 && (size_t) alpha_router_index < routers.size());
+    if (attacker.edgeId < 0 || !validTarget || !validAlpha) {
+        // Not on a street of the graph or heading nowhere, there is nothing to simulate
+        done = true;
+        return false;
+    }
     attacker.fraction = fraction;
-    attacker.position = streetMap.get_position(attacker.edge, attacker.fraction);
+    attacker.position = streetMap->get_position(attacker.edge, attacker.fraction);
     attacker.speed = speed;
     attacker.transmission_prob = tx_prob;
 
-    path.clear();
-    float path_length = streetMap.shortest_path(path, v1, v2, target);
+    // Followers use the trajectory of the leader, which has to be set up with the same attacker first
+    if (leader) {
+        path = leader->path;
+        pathLength = leader->pathLength;
+    } else {
+        path.clear();
+        pathLength = streetMap->shortest_path(path, v1, v2, target);
+        buildTrajectory();
+    }
     completePath = std::deque<int>(path);
 
+    activity.resize(routers.size());
+    activity.clear();
     for (auto &router: routers) {
-        router.active = false;
-        router.activeSince = 0;
+        router.activatedAt = tick;
     }
 
     detectionPoints.push_back(attacker.edge);
@@ -248,18 +436,36 @@ Simulator::setAttacker(int v1, int v2, int target, float fraction, float speed,
     }
 #endif
     // std::cout << "path_length=" << path_length << ", min_path_length=" << min_path_length << std::endl;
-    return path_length >= min_path_length;
+    return pathLength >= min_path_length;
 }
 
-void Simulator::addRouter(int id, int v1, int v2, float fraction, float radius) {
+bool Simulator::addRouter(int id, int v1, int v2, float fraction, float radius) {
     Router router;
     router.id = id;
     router.index = (int) routers.size();
     router.edge = v1 < v2 ? edge_t(v1, v2) : edge_t(v2, v1);
+    if (router.edge.first < 0 || (size_t) router.edge.second >= streetMap->count_vertices()) return false;
+    router.edgeId = streetMap->get_edge_id(router.edge);
+    if (router.edgeId < 0 && streetMap->is_built()) return false;
     router.fraction = fraction;
-    router.position = streetMap.get_position(router.edge, router.fraction);
+    router.position = streetMap->get_position(router.edge, router.fraction);
     router.radius = radius;
     routers.emplace_back(router);
+    activity.resize(routers.size());
+    invalidateNeighborhoods();
+    return true;
+}
+
+bool Simulator::isRouterActive(int index) const {
+    return activity.test(index);
+}
+
+int Simulator::getRouterActiveSince(int index) const {
+    return tick - routers[index].activatedAt;
+}
+
+const RouterActivity &Simulator::getActivity() const {
+    return activity;
 }
 
 Router Simulator::getRouterByIndex(int index) {
@@ -274,6 +480,14 @@ Attacker Simulator::getAttacker() const {
     return attacker;
 }
 
+Simulator::attackerSetup Simulator::getAttackerSetup() const {
+    return lastAttackerSetup;
+}
+
+int Simulator::countVertices() const {
+    return (int) num_vertices(streetMap->graph);
+}
+
 int Simulator::getRouterIndex(int id) const {
     if (id < routers.size() && routers[id].id == id) {
         // Heuristic
@@ -288,32 +502,17 @@ int Simulator::getRouterIndex(int id) const {
 }
 
 edge_t Simulator::random_weighted_edge() {
-    if (random_edge_pool.empty()) {
-        std::vector<int> largest_cc;
-        streetMap.largest_connected_component(largest_cc);
-        streetMap.span(largest_cc, random_edge_pool);
-        float current = 0;
-        for (auto e_w: random_edge_pool) {
-            cumulative_pool_value.emplace_back(std::make_pair(current, current + e_w.second));
-            current += e_w.second;
-        }
-    }
+    int column = random_int((int) streetMap->count_weighted_edges() - 1);
+    return streetMap->weighted_edge(column, random_float());
+}
 
-    float pool_size = cumulative_pool_value.back().second;
-    int min = 0, max = (int) random_edge_pool.size(); // We are currently searching in [min,max)
-    float rand_point = random_float() * pool_size;
-    while (min < max - 1) {
-        auto considered = min + (max - min) / 2;
-        if (cumulative_pool_value[considered].first > rand_point) {
-            max = considered;
-        } else if (cumulative_pool_value[considered].second < rand_point) {
-            min = considered + 1;
-        } else {
-            return random_edge_pool[considered].first;
-        }
+void Simulator::sampleRouterLayout(int n, float radius) {
+    // Same random sequence as adding the routers one by one
+    routers.reserve(routers.size() + n);
+    for (int i = 0; i < n; i++) {
+        auto edge = random_weighted_edge();
+        addRouter((int) routers.size(), edge.first, edge.second, random_float(), radius);
     }
-
-    return random_edge_pool[min].first;
 }
 
 float Simulator::metricActivity() const {
@@ -334,6 +533,39 @@ float Simulator::metricPath() {
     return (path3.matching + 2 * path3.lengthDiff * path3.targetDiff) / 3;
 }
 
+int Simulator::random_target(int source, float min_distance) {
+    // Samples among all vertices at least min_distance away from the source, -1 if there is none
+    // The source is rarely asked again, its row is not worth keeping in the Dijkstra cache of the street map
+    streetMap->one_off_distances(source, targetDistances);
+    std::vector<int> candidates;
+    for (int v = 0; v < targetDistances.size(); v++) {
+        if (targetDistances[v] >= min_distance && targetDistances[v] < std::numeric_limits<float>::max()) {
+            candidates.push_back(v);
+        }
+    }
+    if (candidates.empty()) return -1;
+    return candidates[random_int((int) candidates.size() - 1)];
+}
+
+void Simulator::setSeed(int seed) {
+    generator.seed(seed);
+    this->seed = std::make_pair(true, seed);
+}
+
+void Simulator::setTransmissionKey(uint64_t key) {
+    transmissionKey = std::make_pair(true, key);
+}
+
+void Simulator::clearTransmissionKey() {
+    transmissionKey = std::make_pair(false, 0);
+}
+
+bool Simulator::transmits(int tick) const {
+    // The upper 24 bits of the hash are uniform in [0, 1) with the precision of a float
+    auto r = (float) (splitmix64(transmissionKey.second ^ splitmix64((uint64_t) tick)) >> 40) * 0x1.0p-24f;
+    return attacker.transmission_prob > r;
+}
+
 float Simulator::random_float() {
     return float_distribution(generator);
 }
@@ -343,15 +575,33 @@ int Simulator::random_int(int max) {
     return random;
 }
 
+template<typename Path>
+std::vector<int> Simulator::path_edge_ids(const Path &vertices) const {
+    std::vector<int> ids;
+    ids.reserve(vertices.size());
+    for (int i = 1; i < vertices.size(); i++) {
+        int id = streetMap->get_edge_id(std::make_pair(vertices[i - 1], vertices[i]));
+        if (id >= 0) ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
 Simulator::pathMetric Simulator::metricPath3() {
+    PROFILE_SCOPE(phase_metrics);
     // Reconstruct path
     std::vector<int> reconstructedPath;
     std::deque<int> pathSegment;
     for (int i = 1; i < detectionPoints.size(); i++) {
         pathSegment.clear();
         edge_t d1 = detectionPoints[i - 1], d2 = detectionPoints[i];
-        streetMap.shortest_path(pathSegment, d1.first,
-                                d2.first); // Depending on the number of detection points APSP might be better
+        if (d1.first == d2.first) continue; // Repeated detections on the same edge do not extend the path
+        if (streetMap->has_hierarchy()) {
+            streetMap->shortest_path(pathSegment, d1.first, d2.first);
+        } else {
+            pathFinder.shortest_path(*streetMap, pathSegment, d1.first, d2.first);
+        }
 
         if (pathSegment.empty()) continue; // this should normally not happen, but we want to prevent the function from crashing
         if (reconstructedPath.empty()) {
@@ -374,36 +624,25 @@ Simulator::pathMetric Simulator::metricPath3() {
         }
     }
 
-    std::map<edge_t, bool> edges, reconstructedEdges;
-    for (int i = 1; i < completePath.size(); i++) {
-        auto v1 = completePath[i - 1], v2 = completePath[i];
-        if (v1 < v2)
-            edges[std::make_pair(v1, v2)] = true;
-        else
-            edges[std::make_pair(v2, v1)] = true;
-    }
-    for (int i = 1; i < reconstructedPath.size(); i++) {
-        auto v1 = reconstructedPath[i - 1], v2 = reconstructedPath[i];
-        if (v1 < v2)
-            reconstructedEdges[std::make_pair(v1, v2)] = true;
-        else
-            reconstructedEdges[std::make_pair(v2, v1)] = true;
-    }
+    // Both paths as sorted sets of edge ids, so the overlap is a single merge
+    std::vector<int> edges = path_edge_ids(completePath), reconstructedEdges = path_edge_ids(reconstructedPath);
     float pathLength = 0, reconstructedLength = 0, intersectingLength = 0;
-    for (auto edge_exists: edges) {
-        pathLength += streetMap.get_edge_length(edge_exists.first);
+    for (auto id: edges) {
+        pathLength += streetMap->get_edge_length(id);
     }
-    for (auto edge_exists: reconstructedEdges) {
-        float edge_length = streetMap.get_edge_length(edge_exists.first);
+    auto it = edges.begin();
+    for (auto id: reconstructedEdges) {
+        float edge_length = streetMap->get_edge_length(id);
         reconstructedLength += edge_length;
-        if (edges.find(edge_exists.first) != edges.end()) {
+        while (it != edges.end() && *it < id) it++;
+        if (it != edges.end() && *it == id) {
             intersectingLength += edge_length;
         }
     }
 
     if (pathLength == 0 || reconstructedLength == 0) return {0, 0, 0};
 
-    auto t1 = streetMap.get_position(completePath.back()), t2 = streetMap.get_position(reconstructedPath.back());
+    auto t1 = streetMap->get_position(completePath.back()), t2 = streetMap->get_position(reconstructedPath.back());
     float diff_target = sqrtf(
         (t1.first - t2.first) * (t1.first - t2.first) + (t1.second - t2.second) * (t1.second - t2.second));
     float diff_length = pathLength - reconstructedLength;
@@ -1,48 +1,91 @@
 #ifndef CHASE_SIMULATOR_SIMULATOR_HPP
 #define CHASE_SIMULATOR_SIMULATOR_HPP
 
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <vector>
 
 #include "Attacker.hpp"
 #include "Cluster.hpp"
 #include "Router.hpp"
+#include "RouterActivity.hpp"
 #include "Strategy.hpp"
 #include "StreetMap.hpp"
 #include "ConcurrentReach.hpp"
+#include "PathFinder.hpp"
 
 namespace watchman::simulator {
 
     class Simulator {
-        StreetMap streetMap;
+    public:
+        struct attackerSetup {
+            int v1, v2, target;
+            float fraction, speed, tx_prob;
+            int alpha_router_index;
+        };
+    private:
+        std::shared_ptr<StreetMap> ownStreetMap; // The street map this simulator builds, null for forks
+        std::shared_ptr<const StreetMap> streetMap; // Read only, forks share the one of their scenario
         std::vector<Router> routers;
+        RouterActivity activity;
+        std::shared_ptr<NeighborhoodCache> neighborhoods; // Of the current routers, shared with forks
         Attacker attacker;
-        std::vector<std::pair<edge_t, float>> random_edge_pool;
-        std::vector<std::pair<float, float>> cumulative_pool_value;
+        attackerSetup lastAttackerSetup{};
 
         Strategy *strategy;
         Clustering *clustering;
         ConcurrentReach *concurrentReach;
 
 
+        std::default_random_engine generator;
+        std::uniform_real_distribution<float> float_distribution{0, 1};
         std::pair<bool,int> seed = std::make_pair(false, 0);
+        std::pair<bool,uint64_t> transmissionKey = std::make_pair(false, 0);
         int tick;
         bool done;
+        bool transmission = false; // Whether the attacker sent a packet in the last tick
+        float pathLength = 0;
+        const Simulator *leader = nullptr;
+
+        // Attacker trajectory, fixed by setAttacker. Segment k covers the walked distance up to segmentEnd[k] on
+        // segmentEdges[k], the fraction starts at segmentFraction[k] and changes by segmentDirection[k] per edge length.
+        std::vector<edge_t> segmentEdges;
+        std::vector<int> segmentEdgeIds;
+        std::vector<double> segmentStart, segmentEnd;
+        std::vector<float> segmentLength, segmentFraction, segmentDirection;
+        std::vector<float> segmentX, segmentY, segmentDX, segmentDY; // Position at fraction 0 and per fraction
+        int trajectoryTicks = 0, trajectorySegment = 0; // Position of the precalculation in the trajectory
 
-        // Precalculations
+        // Precalculations, chunks of maxPrecalculations ticks as structure of arrays except for the positions
         const int maxPrecalculations = 8192;
         int precalculationIndex = -1;
         bool precalculationDone = false;
         std::vector<position_t> precalculatedPositions;
-        std::vector<std::pair<edge_t, float>> precalculatedGraphPositions;
+        std::vector<int> precalculatedSegments;
+        std::vector<float> precalculatedFractions;
         std::vector<std::vector<Router>> precalculatedReach;
 
+        void buildTrajectory();
+        void precalculateTrajectory();
+
 
         // Metrics
         int routerTicks;
         std::map<int, bool> detectionEvents, possibleDetectionEvents;
         int latestDetection, latestPossibleDetection;
         std::vector<edge_t> detectionPoints;
+        PathFinder pathFinder; // Reused by metricPath3 to reconstruct the path between detections
+        std::vector<float> targetDistances; // Reused by random_target for the distances from the source
+
+        template<typename Path>
+        std::vector<int> path_edge_ids(const Path &vertices) const;
+        void resolveRouterEdges();
+        // Only sets up the generator and the state, the public constructors decide where street map, reach and
+        // neighborhoods come from
+        Simulator(int seed, std::shared_ptr<const StreetMap> streetMap, ConcurrentReach *concurrentReach,
+                  std::shared_ptr<NeighborhoodCache> neighborhoods);
 
     public:
         struct pathMetric {
@@ -55,19 +98,48 @@ namespace watchman::simulator {
 
         explicit Simulator();
         explicit Simulator(int seed);
+        Simulator(const Simulator &scenario, int seed);
+        Simulator(const Simulator &) = delete;
+        Simulator &operator=(const Simulator &) = delete;
+        ~Simulator();
         void setStrategy(Strategy *p_strategy);
+        // Lockstep runs: a follower takes the trajectory, the reach and the packets of every tick from the leader instead
+        // of calculating them. The leader needs the same routers and has to set up the attacker and tick right before it.
+        void follow(const Simulator *p_leader);
         void addVertex(int vertex, float x, float y);
         void addEdge(int v1, int v2);
+        void addVertices(const float *xy, int n);
+        void addEdges(const int *pairs, int m);
         void buildGraph();
+        void buildGraph(const std::vector<position_t> &vertices, const std::vector<edge_t> &edges);
+        void buildHierarchy(const std::string &cacheFile = "");
         bool setAttacker(int v1, int v2, int target, float fraction, float speed, float tx_prob, int alpha_router_index, float min_path_length);
         [[nodiscard]] Attacker getAttacker() const;
-        void addRouter(int id, int v1, int v2, float fraction, float radius);
+        [[nodiscard]] attackerSetup getAttackerSetup() const;
+        // Routers on an edge the street map does not have are rejected, the ones added before the graph is built are
+        // dropped by buildGraph if their edge is missing
+        bool addRouter(int id, int v1, int v2, float fraction, float radius);
+        // Starts a new neighborhood cache, done whenever the routers change. Strategies set afterwards compute their
+        // neighborhoods again.
+        void invalidateNeighborhoods();
         Router getRouterByIndex(int index);
+        [[nodiscard]] bool isRouterActive(int index) const;
+        [[nodiscard]] int getRouterActiveSince(int index) const; // Ticks since the last activation of the router
+        [[nodiscard]] const RouterActivity &getActivity() const;
         edge_t random_weighted_edge();
+        void sampleRouterLayout(int n, float radius); // Adds n routers on weighted random edges
+        int random_target(int source, float min_distance);
+        void setSeed(int seed); // Also used by later half resets
+        // Draws the transmissions from a counter-based generator indexed by the tick instead of the shared generator, so
+        // runs with the same key see the same packets whatever their strategy and whatever ran before them
+        void setTransmissionKey(uint64_t key);
+        void clearTransmissionKey();
+        [[nodiscard]] bool transmits(int tick) const; // Whether the attacker sends at the tick, needs a transmission key
         float random_float();
         int random_int(int max);
         [[nodiscard]] int getRouterIndex(int id) const;
         [[nodiscard]] int countRouters() const;
+        [[nodiscard]] int countVertices() const;
         [[nodiscard]] int getTick() const;
         [[nodiscard]] bool isDone() const;
         void doTick();
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <limits>
+
+#include "Profiler.hpp"
 #include "Strategy.hpp"
 
 
@@ -10,26 +14,79 @@
 using namespace boost;
 using namespace watchman::simulator;
 
-void Strategy::init(std::vector<Router> &p_routers, std::vector<event_t> &p_events, StreetMap &p_streetMap) {
+void Strategy::init(std::vector<Router> &p_routers, RouterActivity &p_activity, std::vector<event_t> &p_events,
+                    const int &p_tick, const StreetMap &p_streetMap, NeighborhoodCache &p_neighborhoodCache) {
     hasInit = true;
     routers = &p_routers;
+    activity = &p_activity;
     events = &p_events;
+    tick = &p_tick;
     streetMap = &p_streetMap;
+    neighborhoodCache = &p_neighborhoodCache;
+    if (hasActivationTime) expiry.reset();
+    if (!hasNeighborhoods) return;
+
+    // The neighbors in ascending index order, as the strategies found them by scanning the routers
+    float distance = neighborhoodDistance;
+    auto *layout = routers;
+    auto *map = streetMap;
+    NeighborhoodCache::key_t key{neighborhoodMetric, distance, 0};
+    if (neighborhoodMetric == neighborhood_street) {
+        neighborhoods = neighborhoodCache->get(key, layout->size(), [layout, map, distance](int i, std::vector<int> &list) {
+            // The rows of a router are only needed for its own list, they are not kept in the Dijkstra cache
+            const auto &source = (*layout)[i];
+            auto edge = map->get_edge(source.edgeId);
+            std::vector<float> d1, d2;
+            map->one_off_distances(edge.first, d1);
+            map->one_off_distances(edge.second, d2);
+            for (const auto &router: *layout) {
+                if (map->distance(d1, d2, source.edgeId, source.fraction, router.edgeId, router.fraction) < distance) {
+                    list.push_back(router.index);
+                }
+            }
+        });
+    } else {
+        neighborhoods = neighborhoodCache->get(key, layout->size(), [layout, distance](int i, std::vector<int> &list) {
+            const auto &source = (*layout)[i];
+            for (const auto &router: *layout) {
+                if (router.in_reach(source.position, distance)) list.push_back(router.index);
+            }
+        });
+    }
+}
+
+void Strategy::useNeighborhoods(neighborhood_metric_t metric, float distance) {
+    hasNeighborhoods = true;
+    neighborhoodMetric = metric;
+    neighborhoodDistance = distance;
+}
+
+void Strategy::expireAfter(int time) {
+    hasActivationTime = true;
+    // Expiry is checked after the first tick, shorter times act like 0. Deadlines beyond the clamp are never reached in
+    // a run, it keeps tick + time + 1 in range.
+    maxActivationTime = std::clamp(time, 0, std::numeric_limits<int>::max() / 2);
+}
+
+void Strategy::expireActivations() {
+    expiry.expire(*tick, [this](int index) {
+        // Routers activated again since have a later deadline
+        if (*tick - (*routers)[index].activatedAt > maxActivationTime) activity->reset(index);
+    });
 }
 
 void RandomStrategy::setSeed(uint seed) {
     generator.seed(seed);
 }
 
-void RandomStrategy::activateRouterFraction(const std::vector<Router *>& routers) {
+void RandomStrategy::activateRouterFraction(const std::vector<int> &indices) {
     std::uniform_real_distribution<float> distribution(0, 1);
 #define randreal() (distribution(generator))
-    int targetAmount = (int) (routers.size() * fraction);
-    int routersLeft = routers.size();
-    for (auto router: routers) {
+    int targetAmount = (int) (indices.size() * fraction);
+    int routersLeft = indices.size();
+    for (auto index: indices) {
         if (routersLeft > 0 && randreal() < (float) targetAmount / (float) routersLeft) {
-            router->active = true;
-            router->activeSince = 0;
+            activate((*routers)[index]);
             targetAmount--;
         }
         routersLeft--;
@@ -44,8 +101,7 @@ void StaticStrategy::tick0(const Router &alpha) {
 
     for (auto &router: *routers) {
         if (router.in_reach(alpha.position, activationDistance)) {
-            router.active = true;
-            router.activeSince = 0;
+            activate(router);
         }
     }
 }
@@ -54,28 +110,23 @@ void StaticStrategy::run() {
     if (!hasInit) return;
 }
 
-RadiusStrategy::RadiusStrategy(float distance, int time) :
-        activationDistance(distance), maxActivationTime(time) {}
+RadiusStrategy::RadiusStrategy(float distance, int time) {
+    useNeighborhoods(neighborhood_euclidean, distance);
+    expireAfter(time);
+}
 
 void RadiusStrategy::tick0(const Router &alpha) {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        if (router.in_reach(alpha.position, activationDistance)) {
-            router.active = true;
-            router.activeSince = 0;
-        }
+    for (int index: neighborhood(alpha.index)) {
+        activate((*routers)[index]);
     }
 }
 
 void RadiusStrategy::run() {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        if (router.active && router.activeSince > maxActivationTime) {
-            router.active = false;
-        }
-    }
+    expireActivations();
 
     bool moveWindow = false;
 
@@ -89,12 +140,8 @@ void RadiusStrategy::run() {
     if (moveWindow) {
         for (auto event: *events) {
             if (event.type == router_detects) {
-                event.router.activeSince = 0;
-                for (auto &router: *routers) {
-                    if (router.in_reach(event.router.position, activationDistance)) {
-                        router.active = true;
-                        router.activeSince = 0;
-                    }
+                for (int index: neighborhood(event.router.index)) {
+                    activate((*routers)[index]);
                 }
             }
         }
@@ -123,9 +170,7 @@ void kSmartestNeighborsStrategy::run() {
     }
 
     if (moveWindow) {
-        for (auto &router: *routers) {
-            router.active = false;
-        }
+        activity->clear();
 
         for (auto event: *events) {
             if (event.type == router_detects) {
@@ -136,32 +181,45 @@ void kSmartestNeighborsStrategy::run() {
 }
 
 void kSmartestNeighborsStrategy::activateRouter(int index) {
-    if (lazy && neighborhoodLists[index].empty()) {
-        computeNeighborhoodList(index);
+    activate((*routers)[index]);
+    if (lazy) {
+        if (lazyNeighborhoodLists[index].empty()) computeNeighborhoodList(index, lazyNeighborhoodLists[index]);
+        activate(lazyNeighborhoodLists[index]);
+    } else {
+        activate(neighborhood(index));
     }
+}
 
-    (*routers)[index].active = true;
-    for (auto neighbor: neighborhoodLists[index]) {
-        auto &router = (*routers)[neighbor];
-        router.active = true;
+void kSmartestNeighborsStrategy::init(std::vector<Router> &routers, RouterActivity &activity, std::vector<event_t> &events,
+                                      const int &tick, const StreetMap &streetMap, NeighborhoodCache &neighborhoodCache) {
+    Strategy::init(routers, activity, events, tick, streetMap, neighborhoodCache);
+    if (lazy) {
+        prepareGraph();
+        lazyNeighborhoodLists = neighborhood_lists_t(routers.size());
+        return;
     }
-}
 
-void
-kSmartestNeighborsStrategy::init(std::vector<Router> &routers, std::vector<event_t> &events, StreetMap &streetMap) {
-    Strategy::init(routers, events, streetMap);
-    computeNeighborhoodLists();
-}
+    neighborhoods = neighborhoodCache.get({neighborhood_k_smartest, maxDist, k}, [this](neighborhood_lists_t &lists) {
+        prepareGraph();
+        lists.resize(this->routers->size());
 
-void kSmartestNeighborsStrategy::computeNeighborhoodLists() {
-    neighborhoodLists = std::vector<std::vector<int>>(routers->size());
+        // Multiple Dijkstra should be better than APSP as for large scenarios like villages.osm
+        // we have 15000 nodes, but far fewer routers
+        std::map<int, std::vector<short>> dijkstra_cache;
+        for (int i = 0; i < lists.size(); i++) {
+            computeNeighborhoodList(i, lists[i], &dijkstra_cache);
+        }
+    });
+}
 
-    // Data structure for efficient access
+void kSmartestNeighborsStrategy::prepareGraph() {
+    // Data structure for efficient access, indexed by edge id
+    routersByEdgeSortedByFraction = std::vector<std::vector<Router *>>(streetMap->count_edges());
     for (auto &router: *routers) {
-        routersByEdgeSortedByFraction[router.edge].push_back(&router);
+        routersByEdgeSortedByFraction[router.edgeId].push_back(&router);
     }
-    for (auto &edge_router: routersByEdgeSortedByFraction) {
-        std::sort(edge_router.second.begin(), edge_router.second.end(), routerFractionLess);
+    for (auto &edge_routers: routersByEdgeSortedByFraction) {
+        std::sort(edge_routers.begin(), edge_routers.end(), routerFractionLess);
     }
 
     // Create a copy of the graph with the new edge weights
@@ -170,24 +228,16 @@ void kSmartestNeighborsStrategy::computeNeighborhoodLists() {
     for (tie(ei, eiend) = edges(graph); ei != eiend; ++ei) {
         put(edge_weight_t(), graph, *ei, 0);
     }
-    for (const auto &edge_routers: routersByEdgeSortedByFraction) {
-        auto ed = edge(edge_routers.first.first, edge_routers.first.second, graph);
-        put(edge_weight_t(), graph, ed.first, edge_routers.second.size());
-    }
-
-
-    // Multiple Dijkstra should be better than APSP as for large scenarios like villages.osm
-    // we have 15000 nodes, but far fewer routers
-    std::map<int, std::vector<short>> dijkstra_cache;
-
-    if (!lazy) {
-        for (int i = 0; i < routers->size(); i++) {
-            computeNeighborhoodList(i, &dijkstra_cache);
-        }
+    for (int id = 0; id < routersByEdgeSortedByFraction.size(); id++) {
+        if (routersByEdgeSortedByFraction[id].empty()) continue;
+        auto e = streetMap->get_edge(id);
+        auto ed = edge(e.first, e.second, graph);
+        put(edge_weight_t(), graph, ed.first, routersByEdgeSortedByFraction[id].size());
     }
 }
 
-void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::map<int, std::vector<short>> *dijkstra_cache) {
+void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::vector<int> &list,
+                                                         std::map<int, std::vector<short>> *dijkstra_cache) {
     auto V = num_vertices(graph);
     auto &currentRouter = (*routers)[i];
     auto neighborhood = std::vector<bool>(routers->size(), false);
@@ -195,7 +245,8 @@ void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::map<int, st
     // Init first edge
     int kSmall = k, kLarge = k;
     bool foundRouter = false;
-    for (const auto &router: routersByEdgeSortedByFraction[currentRouter.edge]) {
+    const auto &routersOnEdge = routersByEdgeSortedByFraction[currentRouter.edgeId];
+    for (const auto &router: routersOnEdge) {
         if (router->id == currentRouter.id) {
             foundRouter = true;
         } else if (foundRouter) {
@@ -205,8 +256,7 @@ void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::map<int, st
         }
     }
     foundRouter = false;
-    for (auto it = routersByEdgeSortedByFraction[currentRouter.edge].rbegin();
-         it != routersByEdgeSortedByFraction[currentRouter.edge].rend(); it++) {
+    for (auto it = routersOnEdge.rbegin(); it != routersOnEdge.rend(); it++) {
         if ((*it)->id == currentRouter.id) {
             foundRouter = true;
         } else if (foundRouter) {
@@ -246,9 +296,8 @@ void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::map<int, st
                 int to_activate = d[v];
                 edge_t edge = s < t ? edge_t(s, t) : edge_t(t, s);
                 bool forward = edge.first == s;
-                auto routersOnEdgeIt = routersByEdgeSortedByFraction.find(edge);
-                if (routersOnEdgeIt != routersByEdgeSortedByFraction.end()) {
-                    auto &vec = routersOnEdgeIt->second;
+                auto &vec = routersByEdgeSortedByFraction[streetMap->get_edge_id(edge)];
+                if (!vec.empty()) {
                     if (forward) {
                         for (auto &router: vec) {
                             if (--to_activate < 0) break;
@@ -266,15 +315,16 @@ void kSmartestNeighborsStrategy::computeNeighborhoodList(int i, std::map<int, st
     }
 
     // Make neighborhood bool vector to int vector
-    neighborhoodLists[i] = std::vector<int>(0);
+    list = std::vector<int>(0);
     for (int index = 0; index < neighborhood.size(); index++) {
         if (neighborhood[index] && (*routers)[i].in_reach(currentRouter.position, maxDist))
-            neighborhoodLists[i].push_back(index);
+            list.push_back(index);
     }
 }
 
-RandomRadiusStrategy::RandomRadiusStrategy(float distance, int time, float ffraction, uint seed) :
-        activationDistance(distance), maxActivationTime(time) {
+RandomRadiusStrategy::RandomRadiusStrategy(float distance, int time, float ffraction, uint seed) {
+    useNeighborhoods(neighborhood_euclidean, distance);
+    expireAfter(time);
     setSeed(seed);
     fraction = ffraction;
 }
@@ -282,24 +332,13 @@ RandomRadiusStrategy::RandomRadiusStrategy(float distance, int time, float ffrac
 void RandomRadiusStrategy::tick0(const Router &alpha) {
     if (!hasInit) return;
 
-    std::vector<Router*> routersInRange;
-    for (auto &router: *routers) {
-        if (router.in_reach(alpha.position, activationDistance)) {
-            routersInRange.push_back(&router);
-        }
-    }
-
-    activateRouterFraction(routersInRange);
+    activateRouterFraction(neighborhood(alpha.index));
 }
 
 void RandomRadiusStrategy::run() {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        if (router.active && router.activeSince > maxActivationTime) {
-            router.active = false;
-        }
-    }
+    expireActivations();
 
     bool moveWindow = false;
 
@@ -311,24 +350,17 @@ void RandomRadiusStrategy::run() {
     }
 
     if (moveWindow) {
-        std::vector<Router*> routersInRange;
         for (auto event: *events) {
             if (event.type == router_detects) {
-                event.router.activeSince = 0;
-                routersInRange.clear();
-                for (auto &router: *routers) {
-                    if (router.in_reach(event.router.position, activationDistance)) {
-                        routersInRange.push_back(&router);
-                    }
-                }
-                activateRouterFraction(routersInRange);
+                activateRouterFraction(neighborhood(event.router.index));
             }
         }
     }
 }
 
-RandomStreetdistanceStrategy::RandomStreetdistanceStrategy(float distance, int time, float ffraction, uint seed) :
-        activationDistance(distance), maxActivationTime(time) {
+RandomStreetdistanceStrategy::RandomStreetdistanceStrategy(float distance, int time, float ffraction, uint seed) {
+    useNeighborhoods(neighborhood_street, distance);
+    expireAfter(time);
     setSeed(seed);
     fraction = ffraction;
 }
@@ -336,24 +368,13 @@ RandomStreetdistanceStrategy::RandomStreetdistanceStrategy(float distance, int t
 void RandomStreetdistanceStrategy::tick0(const Router &alpha) {
     if (!hasInit) return;
 
-    std::vector<Router*> routersInRange;
-    for (auto &router: *routers) {
-        if (streetMap->distance(alpha.edge, alpha.fraction, router.edge, router.fraction) < activationDistance) {
-            routersInRange.push_back(&router);
-        }
-    }
-
-    activateRouterFraction(routersInRange);
+    activateRouterFraction(neighborhood(alpha.index));
 }
 
 void RandomStreetdistanceStrategy::run() {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        if (router.active && router.activeSince > maxActivationTime) {
-            router.active = false;
-        }
-    }
+    expireActivations();
 
     bool moveWindow = false;
 
@@ -365,17 +386,9 @@ void RandomStreetdistanceStrategy::run() {
     }
 
     if (moveWindow) {
-        std::vector<Router*> routersInRange;
         for (auto event: *events) {
             if (event.type == router_detects) {
-                event.router.activeSince = 0;
-                routersInRange.clear();
-                for (auto &router: *routers) {
-                    if (streetMap->distance(event.router.edge, event.router.fraction, router.edge, router.fraction) < activationDistance) {
-                        routersInRange.push_back(&router);
-                    }
-                }
-                activateRouterFraction(routersInRange);
+                activateRouterFraction(neighborhood(event.router.index));
             }
         }
     }
@@ -384,9 +397,8 @@ void RandomStreetdistanceStrategy::run() {
 void SlidingEuclideanRadiusStrategy::tick0(const Router &alpha) {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        router.active = router.in_reach(alpha.position, activationDistance);
-    }
+    activity->clear();
+    activate(neighborhood(alpha.index));
 }
 
 void SlidingEuclideanRadiusStrategy::run() {
@@ -402,17 +414,11 @@ void SlidingEuclideanRadiusStrategy::run() {
     }
 
     if (moveWindow) {
-        for (auto &router: *routers) {
-            router.active = false;
-        }
+        activity->clear();
 
         for (auto event: *events) {
             if (event.type == router_detects) {
-                for (auto &router: *routers) {
-                    if (router.in_reach(event.router.position, activationDistance)) {
-                        router.active = true;
-                    }
-                }
+                activate(neighborhood(event.router.index));
             }
         }
     }
@@ -421,9 +427,8 @@ void SlidingEuclideanRadiusStrategy::run() {
 void SlidingGraphRadiusStrategy::tick0(const Router &alpha) {
     if (!hasInit) return;
 
-    for (auto &router: *routers) {
-        router.active = streetMap->distance(alpha.edge, alpha.fraction, router.edge, router.fraction) < activationDistance;
-    }
+    activity->clear();
+    activate(neighborhood(alpha.index));
 }
 
 void SlidingGraphRadiusStrategy::run() {
@@ -439,17 +444,11 @@ void SlidingGraphRadiusStrategy::run() {
     }
 
     if (moveWindow) {
-        for (auto &router: *routers) {
-            router.active = false;
-        }
+        activity->clear();
 
         for (auto event: *events) {
             if (event.type == router_detects) {
-                for (auto &router: *routers) {
-                    if (streetMap->distance(event.router.edge, event.router.fraction, router.edge, router.fraction) < activationDistance) {
-                        router.active = true;
-                    }
-                }
+                activate(neighborhood(event.router.index));
             }
         }
     }
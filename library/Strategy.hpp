@@ -5,7 +5,10 @@
 #include <boost/property_map/property_map.hpp>
 #include <boost/graph/copy.hpp>
 #include <random>
+#include "ExpiryWheel.hpp"
+#include "NeighborhoodCache.hpp"
 #include "Router.hpp"
+#include "RouterActivity.hpp"
 
 namespace watchman::simulator {
     typedef enum {
@@ -23,11 +26,49 @@ namespace watchman::simulator {
     protected:
         bool hasInit = false;
         std::vector<Router> *routers;
+        RouterActivity *activity;
         std::vector<event_t> *events;
-        StreetMap *streetMap;
+        const int *tick; // The tick of the simulator
+        const StreetMap *streetMap;
+        NeighborhoodCache *neighborhoodCache;
+
+        // Strategies that activate the routers around a detecting router declare the metric and distance in their
+        // constructor, init then takes the neighborhoods of the layout from the cache
+        bool hasNeighborhoods = false;
+        neighborhood_metric_t neighborhoodMetric = neighborhood_euclidean;
+        float neighborhoodDistance = 0;
+        std::shared_ptr<const neighborhood_lists_t> neighborhoods;
+
+        void useNeighborhoods(neighborhood_metric_t metric, float distance);
+        [[nodiscard]] const std::vector<int> &neighborhood(int index) const { return (*neighborhoods)[index]; };
+
+        // Strategies that deactivate routers a fixed time after their last activation declare it in their constructor,
+        // the deadlines are kept in a timing wheel, so a tick only visits the routers of its wheel slot
+        bool hasActivationTime = false;
+        int maxActivationTime = 0;
+        ExpiryWheel expiry;
+
+        void expireAfter(int time);
+        void expireActivations();
+
+        void activate(Router &router) {
+            activity->set(router.index);
+            router.activatedAt = *tick;
+            // Active for maxActivationTime ticks after the current one
+            if (hasActivationTime) expiry.schedule(router.index, *tick + maxActivationTime + 1);
+        };
+
+        void activate(const std::vector<int> &indices) {
+            activity->set(indices);
+            for (int index: indices) {
+                (*routers)[index].activatedAt = *tick;
+                if (hasActivationTime) expiry.schedule(index, *tick + maxActivationTime + 1);
+            }
+        };
     public:
         virtual ~Strategy() = default;
-        virtual void init(std::vector<Router> &routers, std::vector<event_t> &events, StreetMap &streetMap);
+        virtual void init(std::vector<Router> &routers, RouterActivity &activity, std::vector<event_t> &events,
+                          const int &tick, const StreetMap &streetMap, NeighborhoodCache &neighborhoodCache);
         virtual void tick0(const Router &alpha) = 0;
         virtual void run() = 0;
     };
@@ -37,7 +78,7 @@ namespace watchman::simulator {
         float fraction;
         std::default_random_engine generator;
         void setSeed(uint seed);
-        void activateRouterFraction(const std::vector<Router*>& routers);
+        void activateRouterFraction(const std::vector<int> &indices);
     };
 
     class StaticStrategy : public Strategy {
@@ -49,8 +90,6 @@ namespace watchman::simulator {
     };
 
     class RadiusStrategy : public Strategy {
-        int maxActivationTime;
-        float activationDistance;
     public:
         RadiusStrategy(float distance, int time);
         void tick0(const Router &alpha) override;
@@ -58,17 +97,19 @@ namespace watchman::simulator {
     };
 
     class SlidingEuclideanRadiusStrategy : public Strategy {
-        float activationDistance;
     public:
-        explicit SlidingEuclideanRadiusStrategy(float distance) : activationDistance(distance) {};
+        explicit SlidingEuclideanRadiusStrategy(float distance) {
+            useNeighborhoods(neighborhood_euclidean, distance);
+        };
         void tick0(const Router &alpha) override;
         void run() override;
     };
 
     class SlidingGraphRadiusStrategy : public Strategy {
-        float activationDistance;
     public:
-        explicit SlidingGraphRadiusStrategy(float distance) : activationDistance(distance) {};
+        explicit SlidingGraphRadiusStrategy(float distance) {
+            useNeighborhoods(neighborhood_street, distance);
+        };
         void tick0(const Router &alpha) override;
         void run() override;
     };
@@ -78,22 +119,21 @@ namespace watchman::simulator {
         int k;
         bool lazy;
         float maxDist;
-        std::vector<std::vector<int>> neighborhoodLists;
-        std::map<edge_t, std::vector<Router *>> routersByEdgeSortedByFraction;
+        neighborhood_lists_t lazyNeighborhoodLists; // Otherwise the lists are shared through the cache
+        std::vector<std::vector<Router *>> routersByEdgeSortedByFraction;
 
         void activateRouter(int index);
-        void computeNeighborhoodLists();
-        void computeNeighborhoodList(int index, std::map<int, std::vector<short>> *dijkstra_cache = nullptr);
+        void prepareGraph();
+        void computeNeighborhoodList(int index, std::vector<int> &list, std::map<int, std::vector<short>> *dijkstra_cache = nullptr);
     public:
         kSmartestNeighborsStrategy(int k, float maxDist, bool lazy = false);
-        void init(std::vector<Router> &routers, std::vector<event_t> &events, StreetMap &streetMap) override;
+        void init(std::vector<Router> &routers, RouterActivity &activity, std::vector<event_t> &events,
+                  const int &tick, const StreetMap &streetMap, NeighborhoodCache &neighborhoodCache) override;
         void tick0(const Router &alpha) override;
         void run() override;
     };
 
     class RandomRadiusStrategy : public RandomStrategy {
-        int maxActivationTime;
-        float activationDistance;
     public:
         RandomRadiusStrategy(float distance, int time, float fraction, uint seed);
         void tick0(const Router &alpha) override;
@@ -101,8 +141,6 @@ namespace watchman::simulator {
     };
 
     class RandomStreetdistanceStrategy : public RandomStrategy {
-        int maxActivationTime;
-        float activationDistance;
     public:
         RandomStreetdistanceStrategy(float distance, int time, float fraction, uint seed);
         void tick0(const Router &alpha) override;
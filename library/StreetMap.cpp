@@ -1,15 +1,28 @@
+#include "Profiler.hpp"
 #include "StreetMap.hpp"
 #include <boost/graph/breadth_first_search.hpp>
 #include <boost/graph/connected_components.hpp>
 #include <boost/graph/dijkstra_shortest_paths.hpp>
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 
 using namespace watchman::simulator;
 
 StreetMap::StreetMap() = default;
 
+static inline float euclidean(position_t p1, position_t p2) {
+    return sqrtf((p1.first - p2.first) * (p1.first - p2.first) + (p1.second - p2.second) * (p1.second - p2.second));
+}
+
+static inline uint64_t edge_key(int v1, int v2) {
+    if (v1 > v2) std::swap(v1, v2);
+    return ((uint64_t) (uint32_t) v1 << 32) | (uint32_t) v2;
+}
+
 void StreetMap::add_vertex(int index, position_t position) {
+    if (index < 0) return;
+    if (index >= vertex_positions.size()) vertex_positions.resize(index + 1);
     vertex_positions[index] = position;
 }
 
@@ -18,39 +31,114 @@ void StreetMap::add_edge(edge_t e) {
 }
 
 void StreetMap::add_edge(int v1, int v2) {
+    if (v1 > v2) std::swap(v1, v2); // Edges are always stored as (smaller, larger)
+    if (v1 < 0) return;
+    if (std::max(v1, v2) >= vertex_positions.size()) vertex_positions.resize(std::max(v1, v2) + 1);
     edges.emplace_back(std::make_pair(v1, v2));
-    auto p1 = vertex_positions[v1];
-    auto p2 = vertex_positions[v2];
-    float dist = sqrtf((p1.first - p2.first) * (p1.first - p2.first) + (p1.second - p2.second) * (p1.second - p2.second));
-    weights.push_back(dist);
+    weights.push_back(euclidean(vertex_positions[v1], vertex_positions[v2]));
 }
 
-void StreetMap::build_graph() {
-    graph = graph_t(vertex_positions.size());
-    for (int i = 0; i < edges.size(); i++) {
-        auto e = edges[i];
-        auto w = weights[i];
-        boost::add_edge(e.first, e.second, w, graph);
+void StreetMap::add_vertices(const position_t *positions, size_t n) {
+    vertex_positions.insert(vertex_positions.end(), positions, positions + n);
+}
+
+void StreetMap::add_edges(const edge_t *p_edges, size_t m) {
+    edges.reserve(edges.size() + m);
+    weights.reserve(weights.size() + m);
+    for (size_t i = 0; i < m; i++) {
+        add_edge(p_edges[i]);
     }
+}
+
+void StreetMap::build_graph() {
+    PROFILE_SCOPE(phase_build_graph);
+    // The edge list constructor inserts the edges in order, so the adjacency lists are the same as with add_edge
+    graph = graph_t(edges.begin(), edges.end(), weights.begin(), vertex_positions.size());
 
     property_map<graph_t, vertex_position_t>::type positions = get(vertex_position_t(), graph);
-    for (auto pair: vertex_positions) {
-        positions[pair.first] = pair.second;
+    for (int v = 0; v < vertex_positions.size(); v++) {
+        positions[v] = vertex_positions[v];
     }
+
+    hierarchy.reset();
+
+    std::vector<int> largest_cc;
+    std::vector<std::pair<edge_t, float>> span_edges;
+    largest_connected_component(largest_cc);
+    span(largest_cc, span_edges);
+    sampled_edges.clear();
+    std::vector<float> span_weights;
+    for (const auto &e_w: span_edges) {
+        sampled_edges.push_back(e_w.first);
+        span_weights.push_back(e_w.second);
+    }
+    edge_sampler.build(span_weights);
+
+    // Parallel edges keep the id of the first one, which is also the edge boost::edge finds
+    edge_ids.clear();
+    edge_ids.reserve(edges.size());
+    for (int i = 0; i < edges.size(); i++) {
+        edge_ids.emplace(edge_key(edges[i].first, edges[i].second), i);
+    }
+}
+
+void StreetMap::build_graph(const std::vector<position_t> &vertices, const std::vector<edge_t> &p_edges) {
+    vertex_positions = vertices;
+    edges.clear();
+    weights.clear();
+    add_edges(p_edges.data(), p_edges.size());
+    build_graph();
 }
 
-position_t StreetMap::get_position(edge_t edge, float fraction) {
+position_t StreetMap::get_position(edge_t edge, float fraction) const {
     position_t p1 = vertex_positions[edge.first];
     position_t p2 = vertex_positions[edge.second];
     return std::make_pair(p1.first + (p2.first - p1.first) * fraction, p1.second + (p2.second - p1.second) * fraction);
 }
 
-float StreetMap::get_edge_length(edge_t edge) {
-    std::pair<graph_t::edge_descriptor, bool> ed = boost::edge(edge.first, edge.second, graph);
-    return get(edge_weight, graph, ed.first);
+int StreetMap::get_edge_id(edge_t edge) const {
+    auto it = edge_ids.find(edge_key(edge.first, edge.second));
+    return it == edge_ids.end() ? -1 : it->second;
 }
 
-float StreetMap::shortest_path(std::deque<int> &path, int src, int dest) {
+position_t StreetMap::get_edge_position(int edge_id, float fraction) const {
+    position_t p1 = vertex_positions[edges[edge_id].first];
+    position_t p2 = vertex_positions[edges[edge_id].second];
+    return std::make_pair(p1.first + (p2.first - p1.first) * fraction, p1.second + (p2.second - p1.second) * fraction);
+}
+
+float StreetMap::get_edge_length(edge_t edge) const {
+    int id = get_edge_id(edge);
+    return id < 0 ? 0 : weights[id];
+}
+
+void StreetMap::build_hierarchy() {
+    PROFILE_SCOPE(phase_build_hierarchy);
+    hierarchy = std::make_unique<ContractionHierarchy>();
+    hierarchy->build(num_vertices(graph), edges, weights);
+}
+
+bool StreetMap::load_hierarchy(const std::string &file) {
+    std::ifstream in(file, std::ios::binary);
+    auto loaded = std::make_unique<ContractionHierarchy>();
+    if (!in || !loaded->load(in, ContractionHierarchy::fingerprint(num_vertices(graph), edges, weights))) return false;
+    hierarchy = std::move(loaded);
+    return true;
+}
+
+bool StreetMap::save_hierarchy(const std::string &file) const {
+    if (!hierarchy) return false;
+    std::ofstream out(file, std::ios::binary);
+    return out && hierarchy->save(out);
+}
+
+float StreetMap::shortest_path(std::deque<int> &path, int src, int dest) const {
+    PROFILE_SCOPE(phase_shortest_path);
+    if (hierarchy) {
+        PROFILE_COUNT(counter_hierarchy_queries, 1);
+        return hierarchy->shortest_path(path, src, dest);
+    }
+
     std::vector<vertex_descriptor> p(num_vertices(graph));
     std::vector<float> d(num_vertices(graph));
     vertex_descriptor source = vertex(src, graph);
@@ -70,7 +158,7 @@ float StreetMap::shortest_path(std::deque<int> &path, int src, int dest) {
     return length;
 }
 
-float StreetMap::shortest_path(std::deque<int> &path, int v1, int v2, int dest) {
+float StreetMap::shortest_path(std::deque<int> &path, int v1, int v2, int dest) const {
     float length = shortest_path(path, v1, dest);
     if (path[0] != v2) {
         // First node needs to be either v1 or v2
@@ -110,31 +198,35 @@ void StreetMap::span(const std::vector<int> &vertices, std::vector<std::pair<edg
     }
 }
 
-position_t StreetMap::get_position(int vertex) {
+position_t StreetMap::get_position(int vertex) const {
     graph_t::vertex_descriptor vd = boost::vertex(vertex, graph);
     return get(vertex_position, graph, vd);
 }
 
-float StreetMap::distance(edge_t e1, float f1, edge_t e2, float f2) {
+const std::vector<float> &StreetMap::cached_distances(vertex_descriptor source) const {
+    {
+        std::unique_lock<std::mutex> lock(dijkstra_cache_lock);
+        auto it = dijkstra_cache.find(source);
+        if (it != dijkstra_cache.end()) {
+            PROFILE_COUNT(counter_dijkstra_cache_hits, 1);
+            return *it->second;
+        }
+    }
+    PROFILE_SCOPE(phase_dijkstra);
+
+    // Dijkstra runs without holding the lock, if another thread was faster we keep its result
+    auto *d = new std::vector<float>(num_vertices(graph));
+    dijkstra_shortest_paths(graph, source, distance_map(make_iterator_property_map(d->begin(), get(vertex_index, graph))));
+    std::unique_lock<std::mutex> lock(dijkstra_cache_lock);
+    auto inserted = dijkstra_cache.emplace(source, d);
+    if (!inserted.second) delete d;
+    return *inserted.first->second;
+}
+
+float StreetMap::distance(edge_t e1, float f1, edge_t e2, float f2) const {
     vertex_descriptor v11 = vertex(e1.first, graph), v12 = vertex(e1.second, graph);
     vertex_descriptor v21 = vertex(e2.first, graph), v22 = vertex(e2.second, graph);
-    std::vector<float> *d1, *d2;
-    auto it = dijkstra_cache.find(v11);
-    if (it == dijkstra_cache.end()) {
-        d1 = new std::vector<float>(num_vertices(graph));
-        dijkstra_shortest_paths(graph, v11, distance_map(make_iterator_property_map(d1->begin(), get(vertex_index, graph))));
-        dijkstra_cache[v11] = d1;
-    } else {
-        d1 = it->second;
-    }
-    it = dijkstra_cache.find(v12);
-    if (it == dijkstra_cache.end()) {
-        d2 = new std::vector<float>(num_vertices(graph));
-        dijkstra_shortest_paths(graph, v12, distance_map(make_iterator_property_map(d2->begin(), get(vertex_index, graph))));
-        dijkstra_cache[v12] = d2;
-    } else {
-        d2 = it->second;
-    }
+    const std::vector<float> *d1 = &cached_distances(v11), *d2 = &cached_distances(v12);
 
     float e1l = get_edge_length(e1), e2l = get_edge_length(e2);
     float p0l = (*d1)[v21] + f1 * e1l + f2 * e2l, p1l = (*d1)[v22] + f1 * e1l + (1 - f2) * e2l,
@@ -142,6 +234,38 @@ float StreetMap::distance(edge_t e1, float f1, edge_t e2, float f2) {
     return std::min(std::min(p0l, p1l), std::min(p2l, p3l));
 }
 
+float StreetMap::distance(int e1, float f1, int e2, float f2) const {
+    return distance(cached_distances(edges[e1].first), cached_distances(edges[e1].second), e1, f1, e2, f2);
+}
+
+float StreetMap::distance(const std::vector<float> &d1, const std::vector<float> &d2, int e1, float f1, int e2,
+                          float f2) const {
+    vertex_descriptor v21 = edges[e2].first, v22 = edges[e2].second;
+    float e1l = weights[e1], e2l = weights[e2];
+    float p0l = d1[v21] + f1 * e1l + f2 * e2l, p1l = d1[v22] + f1 * e1l + (1 - f2) * e2l,
+            p2l = d2[v21] + (1 - f1) * e1l + f2 * e2l, p3l = d2[v22] + (1 - f1) * e1l + (1 - f2) * e2l;
+    return std::min(std::min(p0l, p1l), std::min(p2l, p3l));
+}
+
+float StreetMap::one_off_distance(int e1, float f1, int e2, float f2) const {
+    if (!hierarchy) return distance(e1, f1, e2, f2);
+
+    PROFILE_COUNT(counter_hierarchy_queries, 1);
+    // Both ends of the edges are start and end of a single search
+    ContractionHierarchy::endpoint_t sources[] = {{edges[e1].first, f1 * weights[e1]},
+                                                  {edges[e1].second, (1 - f1) * weights[e1]}};
+    ContractionHierarchy::endpoint_t targets[] = {{edges[e2].first, f2 * weights[e2]},
+                                                  {edges[e2].second, (1 - f2) * weights[e2]}};
+    return hierarchy->distance(sources, 2, targets, 2);
+}
+
+void StreetMap::one_off_distances(int source, std::vector<float> &d) const {
+    PROFILE_SCOPE(phase_dijkstra);
+    d.resize(num_vertices(graph));
+    dijkstra_shortest_paths(graph, vertex(source, graph),
+                            distance_map(make_iterator_property_map(d.begin(), get(vertex_index, graph))));
+}
+
 StreetMap::~StreetMap() {
     for (auto e : dijkstra_cache) {
         delete e.second;
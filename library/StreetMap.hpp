@@ -1,10 +1,16 @@
 #ifndef CHASE_SIMULATOR_STREETMAP_HPP
 #define CHASE_SIMULATOR_STREETMAP_HPP
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/properties.hpp>
+#include "AliasTable.hpp"
+#include "ContractionHierarchy.hpp"
 
 using namespace boost;
 
@@ -29,29 +35,73 @@ namespace watchman::simulator {
 
     class StreetMap {
         typedef graph_traits< graph_t >::vertex_descriptor vertex_descriptor;
-        std::map<int, position_t> vertex_positions;
-        std::vector<edge_t> edges;
+        std::vector<position_t> vertex_positions;
+        std::vector<edge_t> edges; // Indexed by edge id
         std::vector<float> weights;
-        std::map<vertex_descriptor, std::vector<float>*> dijkstra_cache;
+        std::unordered_map<uint64_t, int> edge_ids; // Edge id of (v1, v2) with v1 < v2, assigned by build_graph
+        mutable std::map<vertex_descriptor, std::vector<float>*> dijkstra_cache;
+        mutable std::mutex dijkstra_cache_lock; // The street map can be shared by simulators running in parallel
+        std::unique_ptr<ContractionHierarchy> hierarchy; // Optional, replaces Dijkstra in shortest_path and one-off queries
+        std::vector<edge_t> sampled_edges; // Edges of the largest connected component
+        AliasTable edge_sampler; // Samples sampled_edges by their length
+
+        const std::vector<float> &cached_distances(vertex_descriptor source) const;
     public:
         graph_t graph;
         StreetMap();
+        StreetMap(const StreetMap &) = delete;
+        StreetMap &operator=(const StreetMap &) = delete;
         ~StreetMap();
         void add_vertex(int index, position_t position);
         void add_edge(edge_t e);
         void add_edge(int v1, int v2);
+        void add_vertices(const position_t *positions, size_t n);
+        void add_edges(const edge_t *p_edges, size_t m);
         void build_graph();
-        position_t get_position(int vertex);
-        position_t get_position(edge_t edge, float fraction);
-        float get_edge_length(edge_t edge);
+        void build_graph(const std::vector<position_t> &vertices, const std::vector<edge_t> &p_edges);
+        [[nodiscard]] position_t get_position(int vertex) const;
+        [[nodiscard]] position_t get_position(edge_t edge, float fraction) const;
+        position_t get_edge_position(int edge_id, float fraction) const;
+
+        // Edge ids are dense and assigned by build_graph, the pair based lookups resolve the id first
+        [[nodiscard]] int get_edge_id(edge_t edge) const;
+        [[nodiscard]] edge_t get_edge(int edge_id) const { return edges[edge_id]; };
+        [[nodiscard]] float get_edge_length(int edge_id) const { return weights[edge_id]; };
+        [[nodiscard]] float get_edge_length(edge_t edge) const;
+        [[nodiscard]] size_t count_edges() const { return edges.size(); };
+        [[nodiscard]] size_t count_vertices() const { return vertex_positions.size(); };
+        [[nodiscard]] bool is_built() const { return !edge_ids.empty(); }; // Whether build_graph assigned the edge ids
+
+        // Edge of the largest connected component, chosen with probability proportional to its length.
+        // column is uniform in [0, count_weighted_edges()), coin is uniform in [0, 1).
+        [[nodiscard]] size_t count_weighted_edges() const { return edge_sampler.size(); };
+        [[nodiscard]] edge_t weighted_edge(int column, float coin) const {
+            return sampled_edges[edge_sampler.sample(column, coin)];
+        };
+
+        // Preprocessing for fast point to point queries, it has to be repeated after the graph is rebuilt
+        void build_hierarchy();
+        bool load_hierarchy(const std::string &file);
+        bool save_hierarchy(const std::string &file) const;
+        [[nodiscard]] bool has_hierarchy() const { return hierarchy != nullptr; };
 
         void largest_connected_component(std::vector<int> &largest_cc) const;
         void span(const std::vector<int> &vertices, std::vector<std::pair<edge_t, float>> &edges_weights);
 
-        float shortest_path(std::deque<int> &path, int src, int dest);
-        float shortest_path(std::deque<int> &path, int v1, int v2, int dest);
+        // Once the graph is built the queries do not change the street map, a shared one can be used from several threads
+        float shortest_path(std::deque<int> &path, int src, int dest) const;
+        float shortest_path(std::deque<int> &path, int v1, int v2, int dest) const;
 
-        float distance(edge_t e1, float f1, edge_t e2, float f2);
+        // The distance queries keep the Dijkstra rows of the source edge ends, repeated queries from the same router
+        // only look up the rows
+        float distance(edge_t e1, float f1, edge_t e2, float f2) const;
+        float distance(int e1, float f1, int e2, float f2) const;
+        // With the rows d1 and d2 of the ends of e1 given by the caller, e.g. from one_off_distances
+        float distance(const std::vector<float> &d1, const std::vector<float> &d2, int e1, float f1, int e2, float f2) const;
+        // For a source that is not asked again, answered by the hierarchy if there is one instead of caching rows
+        float one_off_distance(int e1, float f1, int e2, float f2) const;
+        // To every vertex, unreachable ones are at FLT_MAX. Runs Dijkstra into the given row and does not cache it
+        void one_off_distances(int source, std::vector<float> &d) const;
     };
 }
 
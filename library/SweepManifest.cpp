@@ -0,0 +1,78 @@
+#include <iomanip>
+#include <sstream>
+
+#include "SweepManifest.hpp"
+
+namespace {
+    const char *MANIFEST_HEADER = "chase-sweep 1";
+}
+
+uint64_t SweepManifest::hash(const std::string &data, uint64_t seed) {
+    uint64_t h = seed;
+    for (unsigned char c: data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::string SweepManifest::configurationId(const std::string &map, int routerCount, int pTx) {
+    std::ostringstream key, id;
+    key << map << '\0' << routerCount << '\0' << pTx;
+    id << std::hex << std::setw(16) << std::setfill('0') << hash(key.str());
+    return id.str();
+}
+
+int SweepManifest::configurationSeed(int sweepSeed, const std::string &id) {
+    uint64_t h = hash(id, hash(std::to_string(sweepSeed)));
+    return (int) ((h ^ (h >> 32)) & 0x7fffffff);
+}
+
+bool SweepManifest::open(const std::string &fileName, const std::string &fingerprint, bool resume, uint64_t resultsSize,
+                         std::string &error) {
+    if (resume) {
+        std::ifstream in(fileName);
+        if (!in) {
+            error = "There is no manifest " + fileName + " to resume from";
+            return false;
+        }
+        std::string line;
+        if (!std::getline(in, line) || line != MANIFEST_HEADER) {
+            error = fileName + " is not a sweep manifest";
+            return false;
+        }
+        if (!std::getline(in, line) || line != "sweep " + fingerprint) {
+            error = fileName + " belongs to a sweep with other options";
+            return false;
+        }
+        // A line that was cut off by the interruption is ignored
+        while (std::getline(in, line)) {
+            std::istringstream entry(line);
+            std::string type, id;
+            uint64_t size;
+            if (!(entry >> type) || !in.good()) continue;
+            if (type == "start" && entry >> size) {
+                checkpointSize = size;
+            } else if (type == "done" && entry >> id >> size) {
+                completedIds.insert(id);
+                checkpointSize = size;
+            }
+        }
+        out.open(fileName, std::ofstream::app);
+    } else {
+        out.open(fileName, std::ofstream::trunc);
+        out << MANIFEST_HEADER << "\n" << "sweep " << fingerprint << "\n" << "start " << resultsSize << std::endl;
+        checkpointSize = resultsSize;
+    }
+    if (!out) {
+        error = "Could not write the manifest " + fileName;
+        return false;
+    }
+    return true;
+}
+
+void SweepManifest::complete(const std::string &id, uint64_t resultsSize) {
+    completedIds.insert(id);
+    checkpointSize = resultsSize;
+    out << "done " << id << " " << resultsSize << std::endl;
+}
@@ -0,0 +1,38 @@
+#ifndef CHASE_SIMULATOR_SWEEPMANIFEST_HPP
+#define CHASE_SIMULATOR_SWEEPMANIFEST_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+
+// Record of the finished configurations of a sweep, so an interrupted sweep can be resumed. Each configuration gets
+// its own seed from the sweep seed and its id, so it yields the same results no matter which configurations ran before.
+// The manifest is a text file:
+//   chase-sweep 1
+//   sweep <fingerprint of the options>
+//   start <size of the results file before the sweep>
+//   done <configuration id> <size of the results file after its results>
+class SweepManifest {
+    std::ofstream out;
+    std::unordered_set<std::string> completedIds;
+    uint64_t checkpointSize = 0;
+
+public:
+    static uint64_t hash(const std::string &data, uint64_t seed = 14695981039346656037ull); // FNV-1a
+    static std::string configurationId(const std::string &map, int routerCount, int pTx);
+    static int configurationSeed(int sweepSeed, const std::string &id);
+
+    // Starts a new manifest, or with resume continues the one of an interrupted sweep with the same fingerprint
+    bool open(const std::string &fileName, const std::string &fingerprint, bool resume, uint64_t resultsSize,
+              std::string &error);
+
+    [[nodiscard]] bool completed(const std::string &id) const { return completedIds.count(id) != 0; };
+    [[nodiscard]] uint64_t resultsSize() const { return checkpointSize; }; // At the last checkpoint
+    [[nodiscard]] size_t countCompleted() const { return completedIds.size(); };
+
+    // Has to be called after the results of the configuration are written
+    void complete(const std::string &id, uint64_t resultsSize);
+};
+
+#endif //CHASE_SIMULATOR_SWEEPMANIFEST_HPP
@@ -0,0 +1,186 @@
+#include <cmath>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "SweepManifest.hpp"
+#include "SweepSpec.hpp"
+
+namespace pt = boost::property_tree;
+
+namespace {
+    const char *strategyNames[strategy_count] = {
+            "static", "radius", "ser", "sgr", "ksn", "random_radius", "random_streetdistance"
+    };
+
+    // A value, a list of values or an inclusive range {"min", "max", "step"}
+    template<typename T>
+    bool readGrid(const pt::ptree &parent, const std::string &name, std::vector<T> &values, std::string &error) {
+        auto node = parent.get_child_optional(name);
+        if (!node) {
+            error = "\"" + name + "\" is missing";
+            return false;
+        }
+        values.clear();
+        if (node->empty()) {
+            values.push_back(node->get_value<T>());
+        } else if (node->count("min")) {
+            auto min = node->get<T>("min"), max = node->get<T>("max", min), step = node->get<T>("step", 1);
+            if (step <= 0) {
+                error = "The step of \"" + name + "\" has to be positive";
+                return false;
+            }
+            // Counted instead of accumulated, so float ranges do not lose their last value to rounding
+            auto count = (long) std::floor((double) (max - min) / (double) step + 1e-6) + 1;
+            for (long i = 0; i < count; i++) values.push_back((T) (min + i * step));
+        } else {
+            for (const auto &entry: *node) values.push_back(entry.second.get_value<T>());
+        }
+        if (values.empty()) {
+            error = "\"" + name + "\" has no values";
+            return false;
+        }
+        return true;
+    }
+
+    bool readStrategies(const pt::ptree &entry, std::vector<StrategyConfiguration> &strategies, std::string &error) {
+        StrategyConfiguration configuration{};
+        auto name = entry.get<std::string>("type", "");
+        if (!parseStrategy(name, configuration.type)) {
+            error = "Unknown strategy \"" + name + "\"";
+            return false;
+        }
+        configuration.lazy = entry.get<bool>("lazy", false);
+
+        // Parameters that a strategy does not have keep a single 0
+        std::vector<float> distances{0}, fractions{0};
+        std::vector<int> times{0}, ks{0};
+        switch (configuration.type) {
+            case strategy_static:
+            case strategy_ser:
+            case strategy_sgr:
+                if (!readGrid(entry, "distance", distances, error)) return false;
+                break;
+            case strategy_radius:
+                if (!readGrid(entry, "distance", distances, error) || !readGrid(entry, "time", times, error)) return false;
+                break;
+            case strategy_ksn:
+                if (!readGrid(entry, "k", ks, error) || !readGrid(entry, "max_dist", distances, error)) return false;
+                break;
+            case strategy_random_radius:
+            case strategy_random_streetdistance:
+                if (!readGrid(entry, "distance", distances, error) || !readGrid(entry, "time", times, error) ||
+                    !readGrid(entry, "fraction", fractions, error))
+                    return false;
+                break;
+            default:
+                break;
+        }
+
+        for (int k: ks) {
+            for (int time: times) {
+                for (float distance: distances) {
+                    for (float fraction: fractions) {
+                        configuration.k = k;
+                        configuration.time = time;
+                        configuration.distance = distance;
+                        configuration.fraction = fraction;
+                        strategies.push_back(configuration);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+}
+
+const char *strategyName(strategy_t type) {
+    return strategyNames[type];
+}
+
+bool parseStrategy(const std::string &name, strategy_t &type) {
+    for (int i = 0; i < strategy_count; i++) {
+        if (name == strategyNames[i]) {
+            type = (strategy_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SweepSpec::load(const std::string &fileName, std::string &error) {
+    pt::ptree root;
+    try {
+        pt::read_json(fileName, root);
+
+        maps.clear();
+        for (const auto &entry: root.get_child("maps")) maps.push_back(entry.second.get_value<std::string>());
+        if (!readGrid(root, "routers", routerCounts, error) || !readGrid(root, "ptx", pTxs, error)) return false;
+        iterations = root.get<int>("iterations", iterations);
+        seed = root.get<int>("seed", seed);
+
+        strategies.clear();
+        for (const auto &entry: root.get_child("strategies")) {
+            if (!readStrategies(entry.second, strategies, error)) return false;
+        }
+    } catch (const pt::file_parser_error &e) {
+        error = e.what(); // Names the file and line
+        return false;
+    } catch (const pt::ptree_error &e) {
+        error = fileName + ": " + e.what();
+        return false;
+    }
+    if (maps.empty()) {
+        error = fileName + " has no maps";
+        return false;
+    }
+    return true;
+}
+
+std::string SweepSpec::describe() const {
+    std::ostringstream text;
+    for (const auto &map: maps) text << map << ";";
+    for (int routerCount: routerCounts) text << routerCount << ",";
+    text << ";";
+    for (int pTx: pTxs) text << pTx << ",";
+    text << ";" << iterations << ";" << seed << ";";
+    for (const auto &strategy: strategies) {
+        text << strategyName(strategy.type) << "," << strategy.distance << "," << strategy.time << "," << strategy.k
+             << "," << strategy.fraction << "," << strategy.lazy << ";";
+    }
+    return text.str();
+}
+
+std::vector<SweepJob> planSweep(const SweepSpec &spec, int shardIndex, int shardCount,
+                                const std::function<bool(const std::string &id)> &skip) {
+    std::vector<SweepJob> jobs;
+    int blockIndex = 0;
+    for (size_t map = 0; map < spec.maps.size(); map++) {
+        size_t graph = jobs.size();
+        jobs.push_back({job_graph, map});
+
+        for (int routerCount: spec.routerCounts) {
+            size_t layout = jobs.size();
+            jobs.push_back({job_layout, map, routerCount, 0, 0, "", graph});
+            for (size_t strategy = 0; strategy < spec.strategies.size(); strategy++) {
+                if (spec.strategies[strategy].usesNeighborhoods()) {
+                    jobs.push_back({job_neighborhoods, map, routerCount, 0, strategy, "", layout});
+                }
+            }
+
+            bool runs = false;
+            for (int pTx: spec.pTxs) {
+                if (blockIndex++ % shardCount != shardIndex) continue;
+                auto id = SweepManifest::configurationId(spec.maps[map], routerCount, pTx);
+                if (skip(id)) continue;
+                jobs.push_back({job_runs, map, routerCount, pTx, 0, id, layout});
+                runs = true;
+            }
+            // Nothing uses the layout
+            if (!runs) jobs.resize(layout);
+        }
+        if (jobs.size() == graph + 1) jobs.resize(graph);
+    }
+    return jobs;
+}
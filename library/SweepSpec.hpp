@@ -0,0 +1,92 @@
+#ifndef CHASE_SIMULATOR_SWEEPSPEC_HPP
+#define CHASE_SIMULATOR_SWEEPSPEC_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef enum {
+    strategy_static,
+    strategy_radius,
+    strategy_ser,
+    strategy_sgr,
+    strategy_ksn,
+    strategy_random_radius,
+    strategy_random_streetdistance,
+    strategy_count
+} strategy_t;
+
+const char *strategyName(strategy_t type);
+bool parseStrategy(const std::string &name, strategy_t &type);
+
+// One point of the parameter grid of a strategy, distances are in km and times in ticks. Unused parameters stay 0.
+struct StrategyConfiguration {
+    strategy_t type;
+    float distance = 0;
+    int time = 0;
+    int k = 0;
+    float fraction = 0;
+    bool lazy = false;
+
+    // Strategies that activate the neighborhoods of routers, which only depend on the router layout and the parameters
+    [[nodiscard]] bool usesNeighborhoods() const {
+        return type != strategy_static && (type != strategy_ksn || !lazy);
+    };
+};
+
+// Grid of a sweep, read from a JSON file:
+//   {
+//     "maps": ["map.osm"],
+//     "routers": {"min": 100, "max": 400, "step": 100},
+//     "ptx": [10, 50, 90],
+//     "iterations": 10,
+//     "seed": 1,
+//     "strategies": [
+//       {"type": "static", "distance": 0.1},
+//       {"type": "radius", "distance": [0.05, 0.1], "time": 30},
+//       {"type": "ser", "distance": {"min": 0.05, "max": 0.2, "step": 0.05}},
+//       {"type": "sgr", "distance": 0.1},
+//       {"type": "ksn", "k": [1, 2, 3], "max_dist": 0.5, "lazy": false},
+//       {"type": "random_radius", "distance": 0.1, "time": 30, "fraction": [0.25, 0.5]},
+//       {"type": "random_streetdistance", "distance": 0.1, "time": 30, "fraction": 0.5}
+//     ]
+//   }
+// Every number may be a single value, a list or an inclusive range. pTx is in percent. iterations and seed are
+// optional and default to the command line.
+struct SweepSpec {
+    std::vector<std::string> maps;
+    std::vector<int> routerCounts;
+    std::vector<int> pTxs;
+    int iterations = 1;
+    int seed = 0;
+    std::vector<StrategyConfiguration> strategies; // The expanded grids, in the order of the file
+
+    bool load(const std::string &fileName, std::string &error);
+    [[nodiscard]] std::string describe() const; // Canonical text of the grid, e.g. for fingerprints
+};
+
+typedef enum {
+    job_graph,         // Parse the map and build the street graph
+    job_layout,        // Sample the router layout of a router count
+    job_neighborhoods, // Compute the activation neighborhoods of a strategy on the layout
+    job_runs           // Run the iterations of all strategies for one pTx, the unit of sharding and resuming
+} job_type_t;
+
+struct SweepJob {
+    job_type_t type;
+    size_t map = 0; // Index into SweepSpec::maps
+    int routerCount = 0;
+    int pTx = 0;
+    size_t strategy = 0; // Index into SweepSpec::strategies of a neighborhood job
+    std::string id; // Configuration id of a run job, see SweepManifest
+    size_t parent = 0; // The job whose result this one builds on, the graph jobs are roots
+};
+
+// Expands the spec into a job tree, graph -> layout -> neighborhoods and runs, and schedules it depth first, so every
+// precomputation is done once right before the first job that needs it and can be dropped after its last one.
+// Run jobs of other shards and the ones skip returns true for are left out, as are precomputations nothing needs.
+std::vector<SweepJob> planSweep(const SweepSpec &spec, int shardIndex, int shardCount,
+                                const std::function<bool(const std::string &id)> &skip);
+
+#endif //CHASE_SIMULATOR_SWEEPSPEC_HPP
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <fstream>
+#include <map>
+
+#include "BenchMaps.hpp"
+
+using namespace watchman::simulator;
+
+const char *bench::bundledMapFile() {
+    return CHASE_BENCH_MAP;
+}
+
+const ParsedOsm *bench::benchMap(benchmark::State &state) {
+    static std::map<int64_t, ParsedOsm> maps;
+    static bool bundledMapMissing = false;
+
+    int64_t n = state.range(0);
+    if (n == BUNDLED_MAP) {
+        state.SetLabel("map.osm");
+        if (bundledMapMissing || !std::ifstream(bundledMapFile())) {
+            bundledMapMissing = true;
+            state.SkipWithError("The bundled map.osm could not be found");
+            return nullptr;
+        }
+    } else {
+        state.SetLabel("grid " + std::to_string(n) + "x" + std::to_string(n));
+    }
+
+    auto cached = maps.find(n);
+    if (cached == maps.end()) {
+        cached = maps.emplace(n, n == BUNDLED_MAP ? parseOsm(bundledMapFile()) : gridMap((int) n)).first;
+    }
+    return &cached->second;
+}
+
+ParsedOsm bench::gridMap(int n) {
+    const float spacing = 0.05;
+    ParsedOsm map{};
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            map.nodes.emplace_back((float) y * spacing, (float) x * spacing);
+            if (x > 0) map.edges.emplace_back(y * n + x - 1, y * n + x);
+            if (y > 0) map.edges.emplace_back((y - 1) * n + x, y * n + x);
+        }
+    }
+    map.bounds[0] = map.bounds[1] = 0;
+    map.bounds[2] = map.bounds[3] = (float) (n - 1) * spacing;
+    return map;
+}
+
+void bench::mapArguments(benchmark::internal::Benchmark *benchmark, const std::vector<int64_t> &extra) {
+    for (int64_t map: {BUNDLED_MAP, (int64_t) 32, (int64_t) 64, (int64_t) 128}) {
+        std::vector<int64_t> arguments{map};
+        arguments.insert(arguments.end(), extra.begin(), extra.end());
+        benchmark->Args(arguments);
+    }
+}
+
+bool bench::Scenario::setup(const ParsedOsm &map, int routerCount, float radius) {
+    simulator.buildGraph(map.nodes, map.edges);
+    simulator.sampleRouterLayout(routerCount, radius);
+
+    // Same minimum path length as the evaluator
+    float minDistance = 0.5f * hypotf(map.bounds[0] - map.bounds[2], map.bounds[1] - map.bounds[3]);
+    for (int attempt = 0; attempt < 100; attempt++, minDistance *= 0.9f) {
+        alphaRouterIndex = simulator.random_int(simulator.countRouters() - 1);
+        Router alphaRouter = simulator.getRouterByIndex(alphaRouterIndex);
+        v1 = alphaRouter.edge.first;
+        v2 = alphaRouter.edge.second;
+        fraction = alphaRouter.fraction;
+        target = simulator.random_target(v1, minDistance);
+        if (target >= 0 &&
+            simulator.setAttacker(v1, v2, target, fraction, speed, txProb, alphaRouterIndex, minDistance)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void bench::Scenario::setAttacker() {
+    simulator.setAttacker(v1, v2, target, fraction, speed, txProb, alphaRouterIndex, 0);
+}
@@ -0,0 +1,42 @@
+#ifndef CHASE_SIMULATOR_BENCHMAPS_HPP
+#define CHASE_SIMULATOR_BENCHMAPS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../OsmParser.hpp"
+#include "../Simulator.hpp"
+
+namespace watchman::simulator::bench {
+
+    // The benchmarks take the map as their first argument: 0 is the bundled map.osm, n > 0 a grid of n x n vertices
+    const int64_t BUNDLED_MAP = 0;
+
+    const char *bundledMapFile();
+
+    // Cached, nullptr and the benchmark is skipped if the bundled map cannot be found
+    const ParsedOsm *benchMap(benchmark::State &state);
+
+    // Grid of n x n vertices with 50 m long streets, the coordinates are in km like the ones of parseOsm
+    ParsedOsm gridMap(int n);
+
+    // Adds the map arguments to a benchmark, every entry is followed by the extra arguments
+    void mapArguments(benchmark::internal::Benchmark *benchmark, const std::vector<int64_t> &extra = {});
+
+    // Simulator on a map with routers and a valid attacker, as the evaluator sets it up
+    struct Scenario {
+        Simulator simulator{1};
+        int v1 = 0, v2 = 0, target = -1, alphaRouterIndex = 0;
+        float fraction = 0;
+        float speed = 0.005;
+        float txProb = 0.5;
+
+        bool setup(const ParsedOsm &map, int routerCount, float radius = 0.02);
+        void setAttacker();
+    };
+}
+
+#endif //CHASE_SIMULATOR_BENCHMAPS_HPP
@@ -0,0 +1,181 @@
+#include <memory>
+#include <random>
+
+#include "BenchMaps.hpp"
+#include "../ConcurrentReach.hpp"
+
+using namespace watchman::simulator;
+using namespace watchman::simulator::bench;
+
+namespace {
+    const int routerCount = 200;
+
+    std::vector<Router> scenarioRouters(Scenario &scenario) {
+        std::vector<Router> routers;
+        for (int i = 0; i < scenario.simulator.countRouters(); i++) {
+            routers.push_back(scenario.simulator.getRouterByIndex(i));
+        }
+        return routers;
+    }
+
+    // Attacker positions spread over the whole map
+    std::vector<position_t> samplePositions(const ParsedOsm &map, int count) {
+        StreetMap streetMap;
+        streetMap.build_graph(map.nodes, map.edges);
+        std::mt19937 generator(1);
+        std::uniform_int_distribution<int> edge(0, (int) streetMap.count_edges() - 1);
+        std::uniform_real_distribution<float> fraction(0, 1);
+        std::vector<position_t> positions;
+        for (int i = 0; i < count; i++) positions.push_back(streetMap.get_edge_position(edge(generator), fraction(generator)));
+        return positions;
+    }
+
+    void runSimulator(Simulator &simulator) {
+        while (!simulator.isDone()) {
+            simulator.doTick();
+        }
+    }
+}
+
+static void BM_ClusteringBuild(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    scenario.setup(*map, (int) state.range(1));
+    auto routers = scenarioRouters(scenario);
+    for (auto _: state) {
+        Clustering clustering(routers);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ClusteringBuild)->Apply([](auto *b) {
+    b->ArgNames({"map", "routers"});
+    mapArguments(b, {routerCount});
+    mapArguments(b, {2000});
+});
+
+static void BM_ClusteringIterate(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    scenario.setup(*map, (int) state.range(1));
+    auto routers = scenarioRouters(scenario);
+    Clustering clustering(routers);
+    auto positions = samplePositions(*map, 1024);
+    size_t i = 0, inReach = 0;
+    for (auto _: state) {
+        for (auto it = clustering.iterator(positions[i++ % positions.size()]); it.hasNext(); it.next()) {
+            inReach++;
+        }
+    }
+    benchmark::DoNotOptimize(inReach);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClusteringIterate)->Apply([](auto *b) {
+    b->ArgNames({"map", "routers"});
+    mapArguments(b, {routerCount});
+    mapArguments(b, {2000});
+});
+
+// Router reach of a chunk of attacker positions, as the simulator precalculates it
+static void BM_Precalculate(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    scenario.setup(*map, routerCount);
+    auto routers = scenarioRouters(scenario);
+    Clustering clustering(routers);
+    ConcurrentReach concurrentReach;
+    concurrentReach.setClustering(&clustering);
+    auto positions = samplePositions(*map, (int) state.range(1));
+    for (auto _: state) {
+        auto reach = concurrentReach.precalculate(positions);
+        benchmark::DoNotOptimize(reach.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Precalculate)->Apply([](auto *b) {
+    b->ArgNames({"map", "positions"});
+    mapArguments(b, {8192});
+})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A complete run of the evaluator: strategy setup, attacker and ticks until the attacker has reached the target. Every
+// iteration computes the neighborhoods of the strategy again, as a run on a new layout does, so the time does not
+// depend on the number of iterations. BM_Neighborhoods measures that part alone.
+template<typename Factory>
+static void BM_Run(benchmark::State &state, Factory strategy) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    if (!scenario.setup(*map, routerCount)) {
+        state.SkipWithError("No valid attacker path");
+        return;
+    }
+    scenario.simulator.setStrategy(strategy()); // Warms the Dijkstra rows of the street map, which outlive layouts
+    int64_t ticks = 0;
+    for (auto _: state) {
+        scenario.simulator.reset();
+        scenario.simulator.invalidateNeighborhoods();
+        scenario.simulator.setStrategy(strategy());
+        scenario.setAttacker();
+        runSimulator(scenario.simulator);
+        ticks += scenario.simulator.getTick();
+    }
+    state.SetItemsProcessed(ticks);
+    state.counters["ticks"] = benchmark::Counter((double) ticks, benchmark::Counter::kAvgIterations);
+}
+
+#define BENCHMARK_RUN(name, strategy) \
+    BENCHMARK_CAPTURE(BM_Run, name, []() -> Strategy * { return strategy; }) \
+        ->Arg(BUNDLED_MAP)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+BENCHMARK_RUN(static, new StaticStrategy(0.1));
+BENCHMARK_RUN(radius, new RadiusStrategy(0.1, 30));
+BENCHMARK_RUN(ser, new SlidingEuclideanRadiusStrategy(0.15));
+BENCHMARK_RUN(sgr, new SlidingGraphRadiusStrategy(0.1));
+BENCHMARK_RUN(ksn, new kSmartestNeighborsStrategy(2, 0.5));
+BENCHMARK_RUN(random_radius, new RandomRadiusStrategy(0.1, 30, 0.5, 1));
+BENCHMARK_RUN(random_streetdistance, new RandomStreetdistanceStrategy(0.1, 30, 0.5, 1));
+
+// Neighborhood computation of a strategy on a layout, which the runs on the layout share
+template<typename Factory>
+static void BM_Neighborhoods(benchmark::State &state, Factory strategy) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    if (!scenario.setup(*map, routerCount)) {
+        state.SkipWithError("No valid attacker path");
+        return;
+    }
+    scenario.simulator.setStrategy(strategy()); // Warms the Dijkstra rows of the street map, which outlive layouts
+    for (auto _: state) {
+        scenario.simulator.invalidateNeighborhoods();
+        scenario.simulator.setStrategy(strategy());
+    }
+}
+
+#define BENCHMARK_NEIGHBORHOODS(name, strategy) \
+    BENCHMARK_CAPTURE(BM_Neighborhoods, name, []() -> Strategy * { return strategy; }) \
+        ->Arg(BUNDLED_MAP)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+BENCHMARK_NEIGHBORHOODS(euclidean, new SlidingEuclideanRadiusStrategy(0.15));
+BENCHMARK_NEIGHBORHOODS(street, new SlidingGraphRadiusStrategy(0.1));
+BENCHMARK_NEIGHBORHOODS(ksn, new kSmartestNeighborsStrategy(2, 0.5));
+
+static void BM_MetricPath3(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    Scenario scenario;
+    if (!scenario.setup(*map, routerCount)) {
+        state.SkipWithError("No valid attacker path");
+        return;
+    }
+    scenario.simulator.reset();
+    scenario.simulator.setStrategy(new SlidingEuclideanRadiusStrategy(0.15));
+    scenario.setAttacker();
+    runSimulator(scenario.simulator);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(scenario.simulator.metricPath3());
+    }
+}
+BENCHMARK(BM_MetricPath3)->Arg(BUNDLED_MAP)->Arg(64);
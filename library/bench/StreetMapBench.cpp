@@ -0,0 +1,153 @@
+#include <deque>
+#include <memory>
+#include <random>
+
+#include "BenchMaps.hpp"
+#include "../PathFinder.hpp"
+
+using namespace watchman::simulator;
+using namespace watchman::simulator::bench;
+
+namespace {
+    std::unique_ptr<StreetMap> buildStreetMap(const ParsedOsm &map) {
+        auto streetMap = std::make_unique<StreetMap>();
+        streetMap->build_graph(map.nodes, map.edges);
+        return streetMap;
+    }
+
+    // Fixed pseudo random queries, every benchmark of a map answers the same ones
+    std::vector<std::pair<int, int>> vertexQueries(const ParsedOsm &map, int count) {
+        std::mt19937 generator(1);
+        std::uniform_int_distribution<int> vertex(0, (int) map.nodes.size() - 1);
+        std::vector<std::pair<int, int>> queries;
+        for (int i = 0; i < count; i++) queries.emplace_back(vertex(generator), vertex(generator));
+        return queries;
+    }
+
+    struct EdgeQuery {
+        int e1, e2;
+        float f1, f2;
+    };
+
+    // The sources are taken from a small set of edges, like the router edges during a simulation
+    std::vector<EdgeQuery> edgeQueries(const StreetMap &streetMap, int count, int sourceCount) {
+        std::mt19937 generator(1);
+        std::uniform_int_distribution<int> edge(0, (int) streetMap.count_edges() - 1);
+        std::uniform_real_distribution<float> fraction(0, 1);
+        std::vector<int> sources;
+        for (int i = 0; i < sourceCount; i++) sources.push_back(edge(generator));
+        std::vector<EdgeQuery> queries;
+        for (int i = 0; i < count; i++) {
+            queries.push_back({sources[i % sourceCount], edge(generator), fraction(generator), fraction(generator)});
+        }
+        return queries;
+    }
+}
+
+static void BM_ParseOsm(benchmark::State &state) {
+    if (!benchMap(state)) return;
+    for (auto _: state) {
+        auto map = parseOsm(bundledMapFile());
+        benchmark::DoNotOptimize(map.edges.data());
+    }
+}
+BENCHMARK(BM_ParseOsm)->Arg(BUNDLED_MAP)->Unit(benchmark::kMillisecond);
+
+static void BM_BuildGraph(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    for (auto _: state) {
+        StreetMap streetMap;
+        streetMap.build_graph(map->nodes, map->edges);
+        benchmark::DoNotOptimize(streetMap.count_edges());
+    }
+    state.counters["edges"] = (double) map->edges.size();
+}
+BENCHMARK(BM_BuildGraph)->Apply([](auto *b) { mapArguments(b); })->Unit(benchmark::kMillisecond);
+
+static void BM_BuildHierarchy(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    auto streetMap = buildStreetMap(*map);
+    for (auto _: state) {
+        streetMap->build_hierarchy();
+    }
+}
+BENCHMARK(BM_BuildHierarchy)->Apply([](auto *b) { mapArguments(b); })->Unit(benchmark::kMillisecond);
+
+// Dijkstra of the street graph, A* of PathFinder and the contraction hierarchy answer the same queries
+static void BM_ShortestPathDijkstra(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    auto streetMap = buildStreetMap(*map);
+    auto queries = vertexQueries(*map, 256);
+    std::deque<int> path;
+    size_t i = 0;
+    for (auto _: state) {
+        auto &query = queries[i++ % queries.size()];
+        path.clear();
+        benchmark::DoNotOptimize(streetMap->shortest_path(path, query.first, query.second));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShortestPathDijkstra)->Apply([](auto *b) { mapArguments(b); });
+
+static void BM_ShortestPathAStar(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    auto streetMap = buildStreetMap(*map);
+    auto queries = vertexQueries(*map, 256);
+    PathFinder pathFinder;
+    std::deque<int> path;
+    size_t i = 0;
+    for (auto _: state) {
+        auto &query = queries[i++ % queries.size()];
+        path.clear();
+        benchmark::DoNotOptimize(pathFinder.shortest_path(*streetMap, path, query.first, query.second));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShortestPathAStar)->Apply([](auto *b) { mapArguments(b); });
+
+static void BM_ShortestPathHierarchy(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    auto streetMap = buildStreetMap(*map);
+    streetMap->build_hierarchy();
+    auto queries = vertexQueries(*map, 256);
+    std::deque<int> path;
+    size_t i = 0;
+    for (auto _: state) {
+        auto &query = queries[i++ % queries.size()];
+        path.clear();
+        benchmark::DoNotOptimize(streetMap->shortest_path(path, query.first, query.second));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShortestPathHierarchy)->Apply([](auto *b) { mapArguments(b); });
+
+// Street distance between two edge positions from the cached Dijkstra rows, or as a one-off query if the second
+// argument selects the contraction hierarchy
+static void BM_Distance(benchmark::State &state) {
+    auto *map = benchMap(state);
+    if (!map) return;
+    auto streetMap = buildStreetMap(*map);
+    bool oneOff = state.range(1);
+    if (oneOff) streetMap->build_hierarchy();
+    auto queries = edgeQueries(*streetMap, 1024, 32);
+    if (!oneOff) {
+        for (const auto &query: queries) streetMap->distance(query.e1, query.f1, query.e2, query.f2); // Fills the cache
+    }
+    size_t i = 0;
+    for (auto _: state) {
+        auto &query = queries[i++ % queries.size()];
+        benchmark::DoNotOptimize(oneOff ? streetMap->one_off_distance(query.e1, query.f1, query.e2, query.f2)
+                                        : streetMap->distance(query.e1, query.f1, query.e2, query.f2));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Distance)->Apply([](auto *b) {
+    b->ArgNames({"map", "hierarchy"});
+    mapArguments(b, {0});
+    mapArguments(b, {1});
+});
@@ -8,201 +8,554 @@
 #define EMSCRIPTEN_KEEPALIVE
 #endif
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
 #include "Simulator.hpp"
 
 using namespace watchman::simulator;
 
-static Simulator globalSimulator = Simulator();
-static event_t event;
-static edge_t random_edge;
 
-extern "C" {
-EMSCRIPTEN_KEEPALIVE void add_vertex(int vertex, float x, float y) {
-    globalSimulator.addVertex(vertex, x, y);
+// Frame written by do_ticks. Every field is 32 bit wide, floats are stored bitwise so that the frame can be read as
+// Int32Array and Float32Array at the same time. The header is followed by frame_event_count events with
+// frame_event_size fields each (type, tick, router index, x, y) and frame_router_count router changes, which are
+// encoded as (router index << 1) | active.
+enum frame_field_t {
+    frame_ticks,
+    frame_tick,
+    frame_done,
+    frame_attacker_v1,
+    frame_attacker_v2,
+    frame_attacker_fraction,
+    frame_attacker_x,
+    frame_attacker_y,
+    frame_event_count,
+    frame_router_count,
+    frame_header_size
+};
+const int frame_event_size = 5;
+
+
+// Strategies passed to run_batch are encoded as batch_strategy_size floats (type, parameter 1, parameter 2, ...) with
+// the parameters of the corresponding set_*_strategy function. The results are stored as [strategy][metric][run].
+// All strategies of a run are evaluated against the same attacker packets.
+enum batch_strategy_t {
+    batch_sample,
+    batch_sliding_window,
+    batch_k_smartest_neighbors
+};
+const int batch_strategy_size = 4;
+
+enum batch_metric_t {
+    batch_activity,
+    batch_detection,
+    batch_last_tracking,
+    batch_path,
+    batch_metric_count
+};
+
+// Simulator instances of the C API. Every call takes the handle returned by sim_create, freed handles are reused.
+struct instance_t {
+    std::unique_ptr<Simulator> simulator;
+    event_t event;
+    edge_t random_edge;
+    std::vector<int32_t> frame;
+    std::vector<bool> frameRouterActive; // Router states the last frame was diffed against
+    std::vector<float> batchResults;
+    std::vector<float> layout;
+};
+
+static std::vector<std::unique_ptr<instance_t>> instances;
+
+// Handles and indexes come from JS unchecked, the exports return error_value for handles that were never created or are
+// destroyed and for indexes out of range instead of trapping: -1, NaN, false or nullptr
+static inline bool valid_handle(int handle) {
+    return handle >= 0 && handle < (int) instances.size() && instances[handle];
+}
+
+#define CHECK_HANDLE(handle, error_value) if (!valid_handle(handle)) return error_value
+#define CHECK_INDEX(index, size, error_value) if ((index) < 0 || (index) >= (size)) return error_value
+
+static inline instance_t &instance(int handle) {
+    return *instances[handle];
+}
+
+static inline Simulator &simulator(int handle) {
+    return *instances[handle]->simulator;
+}
+
+static int add_instance(Simulator *simulator) {
+    auto it = std::find(instances.begin(), instances.end(), nullptr);
+    if (it == instances.end()) it = instances.insert(it, nullptr);
+    *it = std::unique_ptr<instance_t>(new instance_t());
+    (*it)->simulator = std::unique_ptr<Simulator>(simulator);
+    return (int) (it - instances.begin());
+}
+
+static Strategy *make_batch_strategy(const float *strategy) {
+    switch ((int) strategy[0]) {
+        case batch_sample:
+            return new StaticStrategy(strategy[1]);
+        case batch_sliding_window:
+            return new RadiusStrategy(strategy[1], (int) strategy[2]);
+        case batch_k_smartest_neighbors:
+            return new kSmartestNeighborsStrategy((int) strategy[1], strategy[2], strategy[3] != 0);
+        default:
+            return nullptr;
+    }
+}
+
+static bool place_batch_attacker(Simulator &scenario, Simulator::attackerSetup &setup, float min_path_length) {
+    // The attacker starts at a random router and walks to a random node at least min_path_length away
+    for (int tries = 0; tries < 100; tries++) {
+        int alpha = scenario.random_int(scenario.countRouters() - 1);
+        Router router = scenario.getRouterByIndex(alpha);
+        int target = scenario.random_target(router.edge.first, min_path_length);
+        if (target < 0) continue;
+        scenario.reset();
+        if (scenario.setAttacker(router.edge.first, router.edge.second, target, router.fraction, setup.speed,
+                                        setup.tx_prob, alpha, min_path_length)) {
+            setup = scenario.getAttackerSetup();
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline int32_t float_bits(float f) {
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static void sync_frame_routers(instance_t &inst) {
+    inst.frameRouterActive.resize(inst.simulator->countRouters());
+    for (int i = 0; i < inst.frameRouterActive.size(); i++) {
+        inst.frameRouterActive[i] = inst.simulator->isRouterActive(i);
+    }
 }
 
-EMSCRIPTEN_KEEPALIVE void add_edge(int v1, int v2) {
-    globalSimulator.addEdge(v1, v2);
+extern "C" {
+// Creates a simulator with an empty street map and returns its handle
+EMSCRIPTEN_KEEPALIVE int sim_create() {
+    return add_instance(new Simulator());
 }
 
-EMSCRIPTEN_KEEPALIVE void build_graph() {
-    globalSimulator.buildGraph();
+// Creates a simulator sharing the street map and copying the routers of the given scenario. It only reads the
+// shared street map, the graph functions are ignored on it. The attacker and strategy of the new simulator are
+// independent of the scenario. Returns -1 for an invalid scenario.
+EMSCRIPTEN_KEEPALIVE int sim_create_shared(int scenario, int seed) {
+    CHECK_HANDLE(scenario, -1);
+    return add_instance(new Simulator(simulator(scenario), seed));
 }
 
-EMSCRIPTEN_KEEPALIVE void set_sample_strategy(float distance) {
-    auto sampleStrategy = new StaticStrategy(distance);
-    globalSimulator.setStrategy(sampleStrategy);
+EMSCRIPTEN_KEEPALIVE void sim_destroy(int handle) {
+    CHECK_HANDLE(handle, );
+    instances[handle].reset();
 }
 
-EMSCRIPTEN_KEEPALIVE void set_sliding_window_strategy(float distance, int time) {
-    auto slidingWindowStrategy = new RadiusStrategy(distance, time);
-    globalSimulator.setStrategy(slidingWindowStrategy);
+// Simulates the given instances to completion, each on its own thread of the shared pool
+EMSCRIPTEN_KEEPALIVE void sim_run_parallel(const int *handles, int count) {
+    std::vector<ThreadPool::Job> jobs;
+    for (int i = 0; i < count; i++) {
+        if (!valid_handle(handles[i])) continue;
+        auto &simulator = ::simulator(handles[i]);
+        jobs.emplace_back([&simulator]() {
+            while (!simulator.isDone()) {
+                simulator.doTick();
+            }
+        });
+    }
+    ThreadPool::shared().runAll(jobs);
+    for (int i = 0; i < count; i++) {
+        if (valid_handle(handles[i])) sync_frame_routers(instance(handles[i]));
+    }
 }
 
-EMSCRIPTEN_KEEPALIVE void set_k_smartest_neighbors_strategy(int k, float maxDist, bool lazy) {
-    auto strategy = new kSmartestNeighborsStrategy(k, maxDist, lazy);
-    globalSimulator.setStrategy(strategy);
+EMSCRIPTEN_KEEPALIVE void add_vertex(int handle, int vertex, float x, float y) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).addVertex(vertex, x, y);
 }
 
-EMSCRIPTEN_KEEPALIVE
-bool set_attacker(int v1, int v2, int target, float fraction, float speed, float tx_prob, int alpha_router_index, float min_path_length) {
-    return globalSimulator.setAttacker(v1, v2, target, fraction, speed, tx_prob, alpha_router_index, min_path_length);
+EMSCRIPTEN_KEEPALIVE void add_edge(int handle, int v1, int v2) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).addEdge(v1, v2);
 }
 
-EMSCRIPTEN_KEEPALIVE int get_attacker_v1() {
-    return globalSimulator.getAttacker().edge.first;
+EMSCRIPTEN_KEEPALIVE void add_vertices_bulk(int handle, const float *xy, int n) {
+    CHECK_HANDLE(handle, );
+    if (n < 0) return;
+    simulator(handle).addVertices(xy, n);
 }
 
-EMSCRIPTEN_KEEPALIVE int get_attacker_v2() {
-    return globalSimulator.getAttacker().edge.second;
+EMSCRIPTEN_KEEPALIVE void add_edges_bulk(int handle, const int *pairs, int m) {
+    CHECK_HANDLE(handle, );
+    if (m < 0) return;
+    simulator(handle).addEdges(pairs, m);
 }
 
-EMSCRIPTEN_KEEPALIVE float get_attacker_fraction() {
-    return globalSimulator.getAttacker().fraction;
+EMSCRIPTEN_KEEPALIVE void build_graph(int handle) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).buildGraph();
 }
 
-EMSCRIPTEN_KEEPALIVE float get_attacker_x() {
-    return globalSimulator.getAttacker().position.first;
+// Optional preprocessing that speeds up the street distance queries, it has to be repeated after build_graph
+EMSCRIPTEN_KEEPALIVE void build_hierarchy(int handle) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).buildHierarchy();
 }
 
-EMSCRIPTEN_KEEPALIVE float get_attacker_y() {
-    return globalSimulator.getAttacker().position.second;
+EMSCRIPTEN_KEEPALIVE void set_sample_strategy(int handle, float distance) {
+    CHECK_HANDLE(handle, );
+    auto sampleStrategy = new StaticStrategy(distance);
+    simulator(handle).setStrategy(sampleStrategy);
 }
 
-EMSCRIPTEN_KEEPALIVE float get_attacker_speed() {
-    return globalSimulator.getAttacker().speed;
+EMSCRIPTEN_KEEPALIVE void set_sliding_window_strategy(int handle, float distance, int time) {
+    CHECK_HANDLE(handle, );
+    auto slidingWindowStrategy = new RadiusStrategy(distance, time);
+    simulator(handle).setStrategy(slidingWindowStrategy);
 }
 
-EMSCRIPTEN_KEEPALIVE float get_attacker_tx_prob() {
-    return globalSimulator.getAttacker().transmission_prob;
+EMSCRIPTEN_KEEPALIVE void set_k_smartest_neighbors_strategy(int handle, int k, float maxDist, bool lazy) {
+    CHECK_HANDLE(handle, );
+    auto strategy = new kSmartestNeighborsStrategy(k, maxDist, lazy);
+    simulator(handle).setStrategy(strategy);
 }
 
-EMSCRIPTEN_KEEPALIVE void add_router(int id, int v1, int v2, float fraction, float radius) {
-    globalSimulator.addRouter(id, v1, v2, fraction, radius);
+EMSCRIPTEN_KEEPALIVE
+bool set_attacker(int handle, int v1, int v2, int target, float fraction, float speed, float tx_prob, int alpha_router_index, float min_path_length) {
+    CHECK_HANDLE(handle, false);
+    bool success = simulator(handle).setAttacker(v1, v2, target, fraction, speed, tx_prob, alpha_router_index, min_path_length);
+    sync_frame_routers(instance(handle));
+    return success;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_router_id_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).id;
+EMSCRIPTEN_KEEPALIVE int get_attacker_v1(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).getAttacker().edge.first;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_router_v1_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).edge.first;
+EMSCRIPTEN_KEEPALIVE int get_attacker_v2(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).getAttacker().edge.second;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_router_v2_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).edge.second;
+EMSCRIPTEN_KEEPALIVE float get_attacker_fraction(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).getAttacker().fraction;
 }
 
-EMSCRIPTEN_KEEPALIVE float get_router_fraction_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).fraction;
+EMSCRIPTEN_KEEPALIVE float get_attacker_x(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).getAttacker().position.first;
 }
 
-EMSCRIPTEN_KEEPALIVE float get_router_x_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).position.first;
+EMSCRIPTEN_KEEPALIVE float get_attacker_y(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).getAttacker().position.second;
 }
 
-EMSCRIPTEN_KEEPALIVE float get_router_y_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).position.second;
+EMSCRIPTEN_KEEPALIVE float get_attacker_speed(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).getAttacker().speed;
 }
 
-EMSCRIPTEN_KEEPALIVE float get_router_radius_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).radius;
+EMSCRIPTEN_KEEPALIVE float get_attacker_tx_prob(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).getAttacker().transmission_prob;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_router_active_by_index(int index) {
-    return (int) globalSimulator.getRouterByIndex(index).active;
+// Returns false if the street map does not have the edge
+EMSCRIPTEN_KEEPALIVE bool add_router(int handle, int id, int v1, int v2, float fraction, float radius) {
+    CHECK_HANDLE(handle, false);
+    return simulator(handle).addRouter(id, v1, v2, fraction, radius);
 }
 
-EMSCRIPTEN_KEEPALIVE int get_router_active_since_by_index(int index) {
-    return globalSimulator.getRouterByIndex(index).activeSince;
-}
+// Adds n routers on random edges weighted by their length and returns them as [v1, v2, fraction] per router,
+// the pointer is valid until the next call
+EMSCRIPTEN_KEEPALIVE const float *sample_router_layout(int handle, int n, float radius) {
+    CHECK_HANDLE(handle, nullptr);
+    if (n < 0) return nullptr;
+    auto &layout = instance(handle).layout;
+    int first = simulator(handle).countRouters();
+    simulator(handle).sampleRouterLayout(n, radius);
 
-EMSCRIPTEN_KEEPALIVE int get_router_index_by_id(int id) {
-    return globalSimulator.getRouterIndex(id);
+    layout.clear();
+    for (int i = first; i < simulator(handle).countRouters(); i++) {
+        Router router = simulator(handle).getRouterByIndex(i);
+        layout.push_back((float) router.edge.first);
+        layout.push_back((float) router.edge.second);
+        layout.push_back(router.fraction);
+    }
+    return layout.data();
 }
 
-EMSCRIPTEN_KEEPALIVE float metric_activity() {
-    return globalSimulator.metricActivity();
+EMSCRIPTEN_KEEPALIVE int get_router_id_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, simulator(handle).countRouters(), -1);
+    return simulator(handle).getRouterByIndex(index).id;
 }
 
-EMSCRIPTEN_KEEPALIVE float metric_detection() {
-    return globalSimulator.metricDetection();
+EMSCRIPTEN_KEEPALIVE int get_router_v1_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, simulator(handle).countRouters(), -1);
+    return simulator(handle).getRouterByIndex(index).edge.first;
 }
 
-EMSCRIPTEN_KEEPALIVE float metric_last_tracking() {
-    return globalSimulator.metricLastTracking();
+EMSCRIPTEN_KEEPALIVE int get_router_v2_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, simulator(handle).countRouters(), -1);
+    return simulator(handle).getRouterByIndex(index).edge.second;
 }
 
-EMSCRIPTEN_KEEPALIVE float metric_path() {
-    return globalSimulator.metricPath();
+EMSCRIPTEN_KEEPALIVE float get_router_fraction_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, NAN);
+    CHECK_INDEX(index, simulator(handle).countRouters(), NAN);
+    return simulator(handle).getRouterByIndex(index).fraction;
 }
 
-EMSCRIPTEN_KEEPALIVE int count_routers() {
-    return globalSimulator.countRouters();
+EMSCRIPTEN_KEEPALIVE float get_router_x_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, NAN);
+    CHECK_INDEX(index, simulator(handle).countRouters(), NAN);
+    return simulator(handle).getRouterByIndex(index).position.first;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_path_length() {
-    return (int) globalSimulator.path.size();
+EMSCRIPTEN_KEEPALIVE float get_router_y_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, NAN);
+    CHECK_INDEX(index, simulator(handle).countRouters(), NAN);
+    return simulator(handle).getRouterByIndex(index).position.second;
 }
 
-EMSCRIPTEN_KEEPALIVE int get_path_node(int index) {
-    return (int) globalSimulator.path[index];
+EMSCRIPTEN_KEEPALIVE float get_router_radius_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, NAN);
+    CHECK_INDEX(index, simulator(handle).countRouters(), NAN);
+    return simulator(handle).getRouterByIndex(index).radius;
 }
 
-EMSCRIPTEN_KEEPALIVE bool pop_event() {
-    if (globalSimulator.events.empty()) return false;
-
-    event = globalSimulator.events.back();
-    globalSimulator.events.pop_back();
-    return true;
+EMSCRIPTEN_KEEPALIVE int get_router_active_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, simulator(handle).countRouters(), -1);
+    return (int) simulator(handle).isRouterActive(index);
 }
 
-EMSCRIPTEN_KEEPALIVE bool event_is_router_detects() {
-    return event.type == watchman::simulator::router_detects;
+EMSCRIPTEN_KEEPALIVE int get_router_active_since_by_index(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, simulator(handle).countRouters(), -1);
+    return simulator(handle).getRouterActiveSince(index);
 }
 
-EMSCRIPTEN_KEEPALIVE bool event_is_router_misses() {
-    return event.type == watchman::simulator::router_misses;
+EMSCRIPTEN_KEEPALIVE int get_router_index_by_id(int handle, int id) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).getRouterIndex(id);
 }
 
-EMSCRIPTEN_KEEPALIVE int event_router_get_index() {
-    return globalSimulator.getRouterIndex(event.router.id);
+EMSCRIPTEN_KEEPALIVE float metric_activity(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).metricActivity();
 }
 
-EMSCRIPTEN_KEEPALIVE int event_get_tick() {
-    return event.tick;
+EMSCRIPTEN_KEEPALIVE float metric_detection(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).metricDetection();
 }
 
-EMSCRIPTEN_KEEPALIVE void random_weighted_edge_new() {
-    random_edge = globalSimulator.random_weighted_edge();
+EMSCRIPTEN_KEEPALIVE float metric_last_tracking(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).metricLastTracking();
 }
 
-EMSCRIPTEN_KEEPALIVE int random_weighted_edge_v1() {
-    return random_edge.first;
+EMSCRIPTEN_KEEPALIVE float metric_path(int handle) {
+    CHECK_HANDLE(handle, NAN);
+    return simulator(handle).metricPath();
 }
 
-EMSCRIPTEN_KEEPALIVE int random_weighted_edge_v2() {
-    return random_edge.second;
+EMSCRIPTEN_KEEPALIVE int count_routers(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).countRouters();
 }
 
-EMSCRIPTEN_KEEPALIVE void do_tick() {
-    globalSimulator.doTick();
+EMSCRIPTEN_KEEPALIVE int get_path_length(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return (int) simulator(handle).path.size();
 }
 
-EMSCRIPTEN_KEEPALIVE int get_tick() {
-    return globalSimulator.getTick();
+EMSCRIPTEN_KEEPALIVE int get_path_node(int handle, int index) {
+    CHECK_HANDLE(handle, -1);
+    CHECK_INDEX(index, (int) simulator(handle).path.size(), -1);
+    return (int) simulator(handle).path[index];
 }
 
-EMSCRIPTEN_KEEPALIVE bool is_done() {
-    return globalSimulator.isDone();
-}
+EMSCRIPTEN_KEEPALIVE bool pop_event(int handle) {
+    CHECK_HANDLE(handle, false);
+    if (simulator(handle).events.empty()) return false;
 
-EMSCRIPTEN_KEEPALIVE void reset() {
-    globalSimulator.reset();
+    instance(handle).event = simulator(handle).events.back();
+    simulator(handle).events.pop_back();
+    return true;
 }
 
-EMSCRIPTEN_KEEPALIVE void full_reset() {
-    globalSimulator.fullReset();
+EMSCRIPTEN_KEEPALIVE bool event_is_router_detects(int handle) {
+    CHECK_HANDLE(handle, false);
+    return instance(handle).event.type == watchman::simulator::router_detects;
+}
+
+EMSCRIPTEN_KEEPALIVE bool event_is_router_misses(int handle) {
+    CHECK_HANDLE(handle, false);
+    return instance(handle).event.type == watchman::simulator::router_misses;
+}
+
+EMSCRIPTEN_KEEPALIVE int event_router_get_index(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).getRouterIndex(instance(handle).event.router.id);
+}
+
+EMSCRIPTEN_KEEPALIVE int event_get_tick(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return instance(handle).event.tick;
+}
+
+EMSCRIPTEN_KEEPALIVE void random_weighted_edge_new(int handle) {
+    CHECK_HANDLE(handle, );
+    instance(handle).random_edge = simulator(handle).random_weighted_edge();
+}
+
+EMSCRIPTEN_KEEPALIVE int random_weighted_edge_v1(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return instance(handle).random_edge.first;
+}
+
+EMSCRIPTEN_KEEPALIVE int random_weighted_edge_v2(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return instance(handle).random_edge.second;
+}
+
+EMSCRIPTEN_KEEPALIVE void do_tick(int handle) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).doTick();
+}
+
+// Advances the simulation by up to n ticks and returns a frame with the new state (see frame_field_t).
+// The router changes are relative to the previous frame, the pointer is valid until the next call.
+EMSCRIPTEN_KEEPALIVE const int32_t *do_ticks(int handle, int n) {
+    CHECK_HANDLE(handle, nullptr);
+    auto &inst = instance(handle);
+    auto &frame = inst.frame;
+    auto &frameRouterActive = inst.frameRouterActive;
+    frame.assign(frame_header_size, 0);
+
+    int ticks = 0;
+    for (; ticks < n && !simulator(handle).isDone(); ticks++) {
+        simulator(handle).doTick();
+        auto position = simulator(handle).getAttacker().position;
+        for (const auto &e: simulator(handle).events) {
+            frame.push_back(e.type);
+            frame.push_back(e.tick);
+            frame.push_back(e.router.index);
+            frame.push_back(float_bits(position.first));
+            frame.push_back(float_bits(position.second));
+        }
+    }
+    frame[frame_event_count] = (int32_t) ((frame.size() - frame_header_size) / frame_event_size);
+
+    if (frameRouterActive.size() != simulator(handle).countRouters()) {
+        frameRouterActive.resize(simulator(handle).countRouters(), false);
+    }
+    int changes = 0;
+    for (int i = 0; i < frameRouterActive.size(); i++) {
+        bool active = simulator(handle).isRouterActive(i);
+        if (active != frameRouterActive[i]) {
+            frameRouterActive[i] = active;
+            frame.push_back((i << 1) | (int32_t) active);
+            changes++;
+        }
+    }
+    frame[frame_router_count] = changes;
+
+    Attacker attacker = simulator(handle).getAttacker();
+    frame[frame_ticks] = ticks;
+    frame[frame_tick] = simulator(handle).getTick();
+    frame[frame_done] = simulator(handle).isDone();
+    frame[frame_attacker_v1] = attacker.edge.first;
+    frame[frame_attacker_v2] = attacker.edge.second;
+    frame[frame_attacker_fraction] = float_bits(attacker.fraction);
+    frame[frame_attacker_x] = float_bits(attacker.position.first);
+    frame[frame_attacker_y] = float_bits(attacker.position.second);
+    return frame.data();
+}
+
+// Runs every strategy for the given number of runs inside the library and returns the metrics as
+// [strategy][metric][run] (see batch_metric_t), -1 marks runs that could not be performed. The strategies of one run
+// are simulated in parallel against the current attacker, which is replaced between the runs if requested.
+EMSCRIPTEN_KEEPALIVE const float *run_batch(int handle, const float *strategies, int strategy_count, int runs, bool replace_attacker,
+                                            float min_path_length) {
+    CHECK_HANDLE(handle, nullptr);
+    auto &batchResults = instance(handle).batchResults;
+    batchResults.assign(strategy_count * batch_metric_count * runs, -1);
+
+    std::vector<std::unique_ptr<Simulator>> simulators;
+    for (int s = 0; s < strategy_count; s++) {
+        simulators.emplace_back(new Simulator(simulator(handle), simulator(handle).random_int(INT_MAX)));
+    }
+
+    for (int run = 0; run < runs; run++) {
+        auto setup = simulator(handle).getAttackerSetup();
+        if (replace_attacker && !place_batch_attacker(simulator(handle), setup, min_path_length)) break;
+        uint64_t transmissionKey = simulator(handle).random_int(INT_MAX); // The strategies of a run see the same packets
+
+        std::vector<ThreadPool::Job> jobs;
+        for (int s = 0; s < strategy_count; s++) {
+            jobs.emplace_back([&simulators, &setup, &batchResults, strategies, s, runs, run, transmissionKey]() {
+                auto &simulator = *simulators[s];
+                simulator.setTransmissionKey(transmissionKey);
+                auto *strategy = make_batch_strategy(strategies + s * batch_strategy_size);
+                if (!strategy) return;
+
+                simulator.reset();
+                simulator.setStrategy(strategy);
+                // The results of a run without attacker, e.g. if none was ever set, stay at -1
+                if (!simulator.setAttacker(setup.v1, setup.v2, setup.target, setup.fraction, setup.speed, setup.tx_prob,
+                                           setup.alpha_router_index, 0)) return;
+                while (!simulator.isDone()) {
+                    simulator.doTick();
+                }
+
+                float *metrics = &batchResults[s * batch_metric_count * runs + run];
+                metrics[batch_activity * runs] = simulator.metricActivity();
+                metrics[batch_detection * runs] = simulator.metricDetection();
+                metrics[batch_last_tracking * runs] = simulator.metricLastTracking();
+                metrics[batch_path * runs] = simulator.metricPath();
+            });
+        }
+        ThreadPool::shared().runAll(jobs);
+    }
+    sync_frame_routers(instance(handle));
+    return batchResults.data();
+}
+
+EMSCRIPTEN_KEEPALIVE int get_tick(int handle) {
+    CHECK_HANDLE(handle, -1);
+    return simulator(handle).getTick();
+}
+
+EMSCRIPTEN_KEEPALIVE bool is_done(int handle) {
+    CHECK_HANDLE(handle, false);
+    return simulator(handle).isDone();
+}
+
+EMSCRIPTEN_KEEPALIVE void reset(int handle) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).reset();
+    sync_frame_routers(instance(handle));
+}
+
+EMSCRIPTEN_KEEPALIVE void full_reset(int handle) {
+    CHECK_HANDLE(handle, );
+    simulator(handle).fullReset();
+    sync_frame_routers(instance(handle));
 }
 }
 
@@ -210,23 +563,24 @@ EMSCRIPTEN_KEEPALIVE void full_reset() {
 int main() {
     using namespace std;
 
-    full_reset();
-    add_vertex(0, 0, 0);
-    add_vertex(1, 1, 0);
-    add_vertex(2, 2, 0);
-    add_vertex(3, 3, 0);
-    add_vertex(4, 4, 0);
-    add_vertex(5, 2, 2);
-    add_edge(0, 1);
-    add_edge(1, 2);
-    add_edge(2, 3);
-    add_edge(3, 4);
-    add_edge(4, 5);
-    add_edge(0, 5);
-    add_router(0, 0, 1, 0.5, 2);
-    build_graph();
-    globalSimulator.setStrategy(new SlidingGraphRadiusStrategy(1));
-//    cout << globalSimulator.streetMap.distance(make_pair(0, 1), 0.5, make_pair(0, 5), 1) << endl;
-//    cout << globalSimulator.streetMap.distance(make_pair(0, 5), 1, make_pair(0, 1), 0.5) << endl;
+    int handle = sim_create();
+    add_vertex(handle, 0, 0, 0);
+    add_vertex(handle, 1, 1, 0);
+    add_vertex(handle, 2, 2, 0);
+    add_vertex(handle, 3, 3, 0);
+    add_vertex(handle, 4, 4, 0);
+    add_vertex(handle, 5, 2, 2);
+    add_edge(handle, 0, 1);
+    add_edge(handle, 1, 2);
+    add_edge(handle, 2, 3);
+    add_edge(handle, 3, 4);
+    add_edge(handle, 4, 5);
+    add_edge(handle, 0, 5);
+    add_router(handle, 0, 0, 1, 0.5, 2);
+    build_graph(handle);
+    simulator(handle).setStrategy(new SlidingGraphRadiusStrategy(1));
+//    cout << simulator(handle).streetMap.distance(make_pair(0, 1), 0.5, make_pair(0, 5), 1) << endl;
+//    cout << simulator(handle).streetMap.distance(make_pair(0, 5), 1, make_pair(0, 1), 0.5) << endl;
+    sim_destroy(handle);
 }
 #endif // not def EMSCRIPTEN
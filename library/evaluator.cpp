@@ -1,313 +1,588 @@
 #include "evaluator.hpp"
 
-ParsedOsm parseOsm(const char *filename) {
-    rapidxml::file<> file(filename);
-    rapidxml::xml_document<> doc;
-    doc.parse<0>(file.data());
-    map<long long, rapidxml::xml_node<> *> nodes;
-    auto *osm = doc.first_node("osm");
-
-    const float lonToKm = 71.47, latToKm = 111.19;
-
-    // Parse bounds
-    auto *bounds = osm->first_node("bounds");
-    auto *minlatAttr = bounds->first_attribute("minlat");
-    float minlat = strtof(minlatAttr->value(), nullptr) * latToKm;
-    auto *minlonAttr = bounds->first_attribute("minlon");
-    float minlon = strtof(minlonAttr->value(), nullptr) * lonToKm;
-    auto *maxlatAttr = bounds->first_attribute("maxlat");
-    float maxlat = strtof(maxlatAttr->value(), nullptr) * latToKm;
-    auto *maxlonAttr = bounds->first_attribute("maxlon");
-    float maxlon = strtof(maxlonAttr->value(), nullptr) * lonToKm;
-
-    // Parse nodes
-    for (auto *node = osm->first_node("node"); node; node = node->next_sibling("node")) {
-        auto node_id = strtoll(node->first_attribute("id")->value(), nullptr, 10);
-        nodes[node_id] = node;
+void runSimulator(Simulator &simulator) {
+    PROFILE_COUNT(counter_runs, 1);
+    while (!simulator.isDone()) {
+        simulator.doTick();
     }
+}
 
-    vector<struct way> ways;
-    // Parse ways
-    for (auto *way = osm->first_node("way"); way; way = way->next_sibling("way")) {
-        struct way wayStruct;
-        bool isHighway = false;
-        char *highwayType;
-        size_t highwayTypeLen;
-        for (auto *tag = way->first_node("tag"); tag; tag = tag->next_sibling("tag")) {
-            if (strncmp(tag->first_attribute("k")->value(), "highway", tag->first_attribute("k")->value_size()) != 0)
-                continue;
-            isHighway = true;
-            highwayType = tag->first_attribute("v")->value();
-            highwayTypeLen = tag->first_attribute("v")->value_size();
-        }
-        if (!isHighway) continue;
+RunResult describeRun(const RunConfig &runConfig) {
+    RunResult result;
+    result.map = runConfig.map;
+    result.routerCount = runConfig.routerCount;
+    result.txProb = runConfig.att.tx_prob;
+    result.strategy = runConfig.strategy;
+    if (runConfig.strategy == STATIC) {
+        result.setParameter(parameter_static_distance, runConfig.staticParameters.distance);
+    } else if (runConfig.strategy == RADIUS) {
+        result.setParameter(parameter_radius_time, (float) runConfig.radiusParameters.time);
+        result.setParameter(parameter_radius_distance, runConfig.radiusParameters.distance);
+    } else if (runConfig.strategy == SER) {
+        result.setParameter(parameter_ser_distance, runConfig.serParameters.distance);
+    } else if (runConfig.strategy == SGR) {
+        result.setParameter(parameter_sgr_distance, runConfig.sgrParameters.distance);
+    } else if (runConfig.strategy == KSN) {
+        result.setParameter(parameter_ksn_k, (float) runConfig.kSNParameters.k);
+        result.setParameter(parameter_ksn_max_dist, runConfig.kSNParameters.maxDist);
+    } else if (runConfig.strategy == RANDOM_RADIUS) {
+        result.setParameter(parameter_random_radius_time, (float) runConfig.randomRadiusParameters.time);
+        result.setParameter(parameter_random_radius_distance, runConfig.randomRadiusParameters.distance);
+        result.setParameter(parameter_random_radius_fraction, runConfig.randomRadiusParameters.fraction);
+    } else if (runConfig.strategy == RANDOM_STREETDISTANCE) {
+        result.setParameter(parameter_random_streetdistance_time, (float) runConfig.randomStreetdistanceParameters.time);
+        result.setParameter(parameter_random_streetdistance_distance, runConfig.randomStreetdistanceParameters.distance);
+        result.setParameter(parameter_random_streetdistance_fraction, runConfig.randomStreetdistanceParameters.fraction);
+    }
+    return result;
+}
 
-        if (strncmp(highwayType, "primary", highwayTypeLen) != 0 &&
-            strncmp(highwayType, "secondary", highwayTypeLen) != 0 &&
-            strncmp(highwayType, "tertiary", highwayTypeLen) != 0 &&
-            strncmp(highwayType, "residential", highwayTypeLen) != 0 &&
-            strncmp(highwayType, "service", highwayTypeLen) != 0)
-            continue;
+void measureRun(Simulator &simulator, RunResult &result) {
+    result.metrics[metric_activity] = simulator.metricActivity();
+    result.metrics[metric_detection] = simulator.metricDetection();
+    result.metrics[metric_last_tracking] = simulator.metricLastTracking();
+    auto pathMetric = simulator.metricPath3();
+    result.metrics[metric_path_matching] = pathMetric.matching;
+    result.metrics[metric_path_target_diff] = pathMetric.targetDiff;
+    result.metrics[metric_path_length_diff] = pathMetric.lengthDiff;
+}
 
-        for (auto *nd = way->first_node("nd"); nd; nd = nd->next_sibling("nd")) {
-            auto ref = strtoll(nd->first_attribute("ref")->value(), nullptr, 10);
-            wayStruct.nodes.push_back(ref);
-        }
-        ways.emplace_back(wayStruct);
-    }
+float minPathLength(const ParsedOsm &map) {
+    // todo there might be an error with the min_distance or the path finding, this is partly fixed but I still have a suspicious feeling
+    return 0.5 * sqrtf((map.bounds[0] - map.bounds[2]) * (map.bounds[0] - map.bounds[2]) +
+                       (map.bounds[1] - map.bounds[3]) * (map.bounds[1] - map.bounds[3]));
+}
 
-    vector<pair<float, float>> indexedNodes;
-    vector<pair<int, int>> edges;
-    int index = 0;
-    map<long long, int> nodeMapping;
-
-    for (auto &way: ways) {
-        int prev = -1;
-        for (auto nd: way.nodes) {
-            if (nodeMapping.find(nd) == nodeMapping.end()) {
-                nodeMapping[nd] = index++;
-                indexedNodes.emplace_back(
-                        make_pair(strtof(nodes[nd]->first_attribute("lat")->value(), nullptr) * latToKm,
-                                  strtof(nodes[nd]->first_attribute("lon")->value(), nullptr) * lonToKm));
-            }
-            int curr = nodeMapping[nd];
-            if (prev >= 0) {
-                edges.emplace_back(make_pair(prev, curr));
-            }
-            prev = curr;
-        }
+bool selectAttacker(Simulator &simulator, RunConfig &runConfig, float minPathLength) {
+    // Attacker parameters are fixed for all strategies of an iteration
+    runConfig.att.alpha_router_index = simulator.random_int(simulator.countRouters() - 1);
+    Router alphaRouter = simulator.getRouterByIndex(runConfig.att.alpha_router_index);
+    runConfig.att.v1 = alphaRouter.edge.first;
+    runConfig.att.v2 = alphaRouter.edge.second;
+    runConfig.att.fraction = alphaRouter.fraction;
+    runConfig.att.target = -1;
+
+    // Find possible target, the path length is measured from v1
+    int target = simulator.random_target(runConfig.att.v1, minPathLength);
+    if (target >= 0 && simulator.setAttacker(runConfig.att.v1, runConfig.att.v2, target, runConfig.att.fraction,
+                                             ATTACKER_SPEED, runConfig.att.tx_prob, runConfig.att.alpha_router_index,
+                                             minPathLength)) {
+        runConfig.att.target = target;
     }
+    return runConfig.att.target != -1;
+}
 
-    if (!indexedNodes.empty()) { // The condition is only to prevent crashes on errornous maps
-        // Compute better bounds
-        minlat = maxlat = indexedNodes[0].first;
-        minlon = maxlon = indexedNodes[0].second;
+bool loadSweepSpec(const ProgramOptions &programOptions, SweepSpec &spec, string &error) {
+    spec.iterations = programOptions.num_iterations;
+    spec.seed = programOptions.seed;
+    if (!programOptions.specFile.empty()) return spec.load(programOptions.specFile, error);
 
-        for (const auto &node: indexedNodes) {
-            if (minlat > node.first) minlat = node.first;
-            if (maxlat < node.first) maxlat = node.first;
-            if (minlon > node.second) minlon = node.second;
-            if (maxlon < node.second) maxlon = node.second;
+    // The grid of the command line options, ranges are in m
+    auto range = [&error](const string &name, int min, int max, int step, vector<int> &values) {
+        if (step <= 0) {
+            error = "--" + name + "-step has to be positive";
+            return false;
         }
-    }
-
-    return {
-            .bounds = {minlat, minlon, maxlat, maxlon},
-            .nodes = indexedNodes,
-            .edges = edges
+        for (int value = min; value <= max; value += step) values.push_back(value);
+        return true;
     };
+    vector<int> serRanges, sgrRanges, ksnKs, ksnDists;
+    spec.maps = programOptions.maps;
+    if (!range("router", programOptions.routerMin, programOptions.routerMax, programOptions.routerStep, spec.routerCounts) ||
+        !range("ptx", programOptions.pTxMin, programOptions.pTxMax, programOptions.pTxStep, spec.pTxs) ||
+        !range("ser-range", programOptions.serRangeMin, programOptions.serRangeMax, programOptions.serRangeStep, serRanges) ||
+        !range("sgr-range", programOptions.sgrRangeMin, programOptions.sgrRangeMax, programOptions.sgrRangeStep, sgrRanges) ||
+        !range("ksn-k", programOptions.ksnKMin, programOptions.ksnKMax, programOptions.ksnKStep, ksnKs) ||
+        !range("ksn-dist", programOptions.ksnDistMin, programOptions.ksnDistMax, programOptions.ksnDistStep, ksnDists)) {
+        return false;
+    }
+    for (int distance: serRanges) {
+        StrategyConfiguration configuration{strategy_ser};
+        configuration.distance = distance / 1000.0;
+        spec.strategies.push_back(configuration);
+    }
+    for (int distance: sgrRanges) {
+        StrategyConfiguration configuration{strategy_sgr};
+        configuration.distance = distance / 1000.0;
+        spec.strategies.push_back(configuration);
+    }
+    for (int k: ksnKs) {
+        for (int distance: ksnDists) {
+            StrategyConfiguration configuration{strategy_ksn};
+            configuration.k = k;
+            configuration.distance = distance / 1000.0;
+            spec.strategies.push_back(configuration);
+        }
+    }
+    return true;
 }
 
-void runSimulator(Simulator &simulator) {
-    while (!simulator.isDone()) {
-        simulator.doTick();
+Strategy *createStrategy(const StrategyConfiguration &configuration, unsigned seed) {
+    float distance = configuration.distance;
+    int time = configuration.time;
+    switch (configuration.type) {
+        case strategy_static:
+            return new StaticStrategy(distance);
+        case strategy_radius:
+            return new RadiusStrategy(distance, time);
+        case strategy_ser:
+            return new SlidingEuclideanRadiusStrategy(distance);
+        case strategy_sgr:
+            return new SlidingGraphRadiusStrategy(distance);
+        case strategy_ksn:
+            return new kSmartestNeighborsStrategy(configuration.k, distance, configuration.lazy);
+        case strategy_random_radius:
+            return new RandomRadiusStrategy(distance, time, configuration.fraction, seed);
+        case strategy_random_streetdistance:
+            return new RandomStreetdistanceStrategy(distance, time, configuration.fraction, seed);
+        default:
+            return nullptr;
     }
 }
 
-void saveResult(Simulator &simulator, const RunConfig &runConfig, ofstream &file) {
-    file << runConfig.map << ",";
-    file << runConfig.routerCount << ",";
-    file << runConfig.att.tx_prob << ",";
-    file << runConfig.strategy << ",";
-    if (runConfig.strategy == STATIC) {
-        file << runConfig.staticParameters.distance << ",";
-    } else {
-        file << ",";
-    }
-    if (runConfig.strategy == RADIUS) {
-        file << runConfig.radiusParameters.time << ",";
-        file << runConfig.radiusParameters.distance << ",";
-    } else {
-        file << "," << ",";
+void forEachStrategy(const SweepSpec &spec, RunConfig &runConfig, const StrategyRun &run) {
+    for (const auto &configuration: spec.strategies) {
+        float distance = configuration.distance;
+        int time = configuration.time;
+        switch (configuration.type) {
+            case strategy_static:
+                runConfig.strategy = STATIC;
+                runConfig.staticParameters.distance = distance;
+                break;
+            case strategy_radius:
+                runConfig.strategy = RADIUS;
+                runConfig.radiusParameters.time = time;
+                runConfig.radiusParameters.distance = distance;
+                break;
+            case strategy_ser:
+                runConfig.strategy = SER;
+                runConfig.serParameters.distance = distance;
+                break;
+            case strategy_sgr:
+                runConfig.strategy = SGR;
+                runConfig.sgrParameters.distance = distance;
+                break;
+            case strategy_ksn:
+                runConfig.strategy = KSN;
+                runConfig.kSNParameters.k = configuration.k;
+                runConfig.kSNParameters.maxDist = distance;
+                break;
+            case strategy_random_radius:
+                runConfig.strategy = RANDOM_RADIUS;
+                runConfig.randomRadiusParameters.time = time;
+                runConfig.randomRadiusParameters.distance = distance;
+                runConfig.randomRadiusParameters.fraction = configuration.fraction;
+                break;
+            case strategy_random_streetdistance:
+                runConfig.strategy = RANDOM_STREETDISTANCE;
+                runConfig.randomStreetdistanceParameters.time = time;
+                runConfig.randomStreetdistanceParameters.distance = distance;
+                runConfig.randomStreetdistanceParameters.fraction = configuration.fraction;
+                break;
+            default:
+                continue;
+        }
+        run(createStrategy(configuration, runConfig.strategySeed));
     }
-    if (runConfig.strategy == SER) {
-        file << runConfig.serParameters.distance << ",";
-    } else {
-        file << ",";
+}
+
+void performRun(Simulator &simulator, Strategy *strategy, const RunConfig &runConfig) {
+    simulator.reset();
+    simulator.setStrategy(strategy);
+    simulator.setAttacker(runConfig.att.v1, runConfig.att.v2, runConfig.att.target, runConfig.att.fraction,
+                          ATTACKER_SPEED, runConfig.att.tx_prob, runConfig.att.alpha_router_index, 0);
+    runSimulator(simulator);
+}
+
+int main(int argc, char **argv) {
+
+    ProgramOptions programOptions = parseProgramOptions(argc, argv);
+
+    SweepSpec spec;
+    string specError;
+    if (!loadSweepSpec(programOptions, spec, specError)) {
+        cerr << specError << endl;
+        return 1;
     }
-    if (runConfig.strategy == SGR) {
-        file << runConfig.sgrParameters.distance << ",";
-    } else {
-        file << ",";
+
+    if (programOptions.bench) {
+        runBench(programOptions, spec);
+        reportProfile(programOptions);
+        return 0;
     }
-    if (runConfig.strategy == KSN) {
-        file << runConfig.kSNParameters.k << ",";
-        file << runConfig.kSNParameters.maxDist << ",";
-    } else {
-        file << "," << ",";
+
+    if (programOptions.resume && programOptions.outputFormat == "summary") {
+        cerr << "A summary cannot be resumed, its configurations are only written at the end" << endl;
+        return 1;
     }
-    if (runConfig.strategy == RANDOM_RADIUS) {
-        file << runConfig.randomRadiusParameters.time << ",";
-        file << runConfig.randomRadiusParameters.distance << ",";
-        file << runConfig.randomRadiusParameters.fraction << ",";
-    } else {
-        file << "," << ",";
+    SweepManifest manifest;
+    string manifestError;
+    std::error_code sizeError;
+    uint64_t resultsSize = filesystem::exists(programOptions.outputFile) ? filesystem::file_size(programOptions.outputFile) : 0;
+    if (!programOptions.dryRun && !manifest.open(programOptions.outputFile + ".manifest", sweepFingerprint(programOptions, spec),
+                                                 programOptions.resume, resultsSize, manifestError)) {
+        cerr << manifestError << endl;
+        return 1;
     }
-    if (runConfig.strategy == RANDOM_STREETDISTANCE) {
-        file << runConfig.randomStreetdistanceParameters.time << ",";
-        file << runConfig.randomStreetdistanceParameters.distance << ",";
-        file << runConfig.randomStreetdistanceParameters.fraction << ",";
-    } else {
-        file << "," << ",";
+    if (programOptions.resume && !programOptions.dryRun) {
+        // Results of the interrupted configuration are dropped, it runs again
+        if (manifest.resultsSize() > resultsSize) {
+            cerr << programOptions.outputFile << " is shorter than its manifest records" << endl;
+            return 1;
+        }
+        if (resultsSize != manifest.resultsSize()) {
+            filesystem::resize_file(programOptions.outputFile, manifest.resultsSize(), sizeError);
+        }
+        if (sizeError) {
+            cerr << "Could not truncate " << programOptions.outputFile << ": " << sizeError.message() << endl;
+            return 1;
+        }
+        cerr << "Resuming after " << manifest.countCompleted() << " configurations" << endl;
     }
-    file << simulator.metricActivity() << ",";
-    file << simulator.metricDetection() << ",";
-    file << simulator.metricLastTracking() << ",";
-    auto pathMetric = simulator.metricPath3();
-    file << pathMetric.matching << ",";
-    file << pathMetric.targetDiff << ",";
-    file << pathMetric.lengthDiff << endl;
-}
 
-int main(int argc, char **argv) {
+    auto sink = ResultSink::open(programOptions.outputFormat, programOptions.outputFile);
+    if (!sink || !sink->good()) {
+        cerr << "Could not open " << programOptions.outputFile << " as " << programOptions.outputFormat << endl;
+        return 1;
+    }
+    ResultWriter results(*sink);
 
-    ProgramOptions programOptions = parseProgramOptions(argc, argv);
+    // Without an adaptive metric every configuration runs the iterations of the spec
+    metric_t adaptiveMetric = metric_count;
+    if (!programOptions.adaptiveMetric.empty() && !parseMetric(programOptions.adaptiveMetric, adaptiveMetric)) {
+        cerr << "Unknown metric " << programOptions.adaptiveMetric << endl;
+        return 1;
+    }
+    AdaptiveStopping stopping(programOptions.ciWidth, programOptions.confidence, max(3, programOptions.minIterations));
 
-    ofstream results(programOptions.outputFile, ofstream::app);
+    int max_iteration_retries = spec.iterations / 2;
+    const int seed = spec.seed;
 
-    int max_iteration_retries = programOptions.num_iterations / 2;
-    float radius = 0.02; // 20m
-    float speed = 0.005; // 5m/s
+    if (!programOptions.traceFile.empty()) profiler::enableTrace();
 
-    const int seed = programOptions.seed;
+    auto jobs = planSweep(spec, programOptions.shardIndex, programOptions.shardCount,
+                          [&](const string &id) { return manifest.completed(id); });
 
     RunConfig runConfig;
-    for (const auto &mapFile: programOptions.maps) {
-        runConfig.map = mapFile.c_str();
+    ParsedOsm map;
+    unique_ptr<Simulator> simulator;
+    for (const auto &job: jobs) {
+        const string &mapFile = spec.maps[job.map];
+
+        if (job.type == job_graph) {
+            runConfig.map = mapFile.c_str();
+            {
+                PROFILE_SCOPE(phase_parse);
+                map = parseOsm(runConfig.map);
+            }
+            cout << mapFile << endl;
+            cerr << "  Edges: " << map.edges.size() << endl;
+            cerr << "  Nodes: " << map.nodes.size() << endl;
+            cerr << "  Bounds: " << map.bounds[0] << "," << map.bounds[2] << " | " << map.bounds[1] << "," << map.bounds[3]
+                 << endl;
+
+            simulator = make_unique<Simulator>(seed);
+            simulator->buildGraph(map.nodes, map.edges);
+            if (programOptions.contractionHierarchy) simulator->buildHierarchy(mapFile + ".ch");
+            continue;
+        }
 
-        auto map = parseOsm(runConfig.map);
-        cout << mapFile << endl;
-        cerr << "  Edges: " << map.edges.size() << endl;
-        cerr << "  Nodes: " << map.nodes.size() << endl;
-        cerr << "  Bounds: " << map.bounds[0] << "," << map.bounds[2] << " | " << map.bounds[1] << "," << map.bounds[3]
-             << endl;
+        if (job.type == job_layout) {
+            runConfig.routerCount = job.routerCount;
+            simulator->setSeed(seed); // The layout only depends on the seed and the router count
+            simulator->halfReset();
+            simulator->sampleRouterLayout(job.routerCount, ROUTER_RADIUS);
+            continue;
+        }
 
-        // todo there might be an error with the min_distance or the path finding, this is partly fixed but I still have a suspicious feeling
-        float min_distance = 0.5 * sqrtf((map.bounds[0] - map.bounds[2]) * (map.bounds[0] - map.bounds[2]) +
-                                         (map.bounds[1] - map.bounds[3]) * (map.bounds[1] - map.bounds[3]));
+        if (job.type == job_neighborhoods) {
+            if (programOptions.dryRun) continue;
+            // Initializing the strategy fills the neighborhood cache of the layout, which all its runs use
+            simulator->setStrategy(createStrategy(spec.strategies[job.strategy], 0));
+            continue;
+        }
 
-        auto simulator = Simulator(seed);
-        {
-            int i = 0;
-            for (auto node: map.nodes) {
-                simulator.addVertex(i++, node.first, node.second);
+        int blockSeed = SweepManifest::configurationSeed(seed, job.id);
+        simulator->setSeed(blockSeed);
+        float min_distance = minPathLength(map);
+        runConfig.att.tx_prob = job.pTx / 100.0;
+        int max_iteration_retries_ctr = max_iteration_retries;
+        stopping.clear();
+
+        for (int iteration = 0; iteration < spec.iterations; iteration++) {
+            if (adaptiveMetric != metric_count && stopping.allConverged()) break;
+            if (!selectAttacker(*simulator, runConfig, min_distance)) {
+                cerr << "Could not find a valid attacker path. min_distance=" << min_distance << endl;
+                cerr << "bounds=[" << map.bounds[0] << ", " << map.bounds[1] << ", " << map.bounds[2] << ", "
+                     << map.bounds[3] << "]" << endl;
+                if (max_iteration_retries_ctr > 0) {
+                    max_iteration_retries_ctr--;
+                    iteration--;
+                } else {
+                    min_distance = 0.99 * min_distance;
+                }
+                continue;
             }
-            for (auto edge: map.edges) {
-                simulator.addEdge(edge.first, edge.second);
+            runConfig.strategySeed = (unsigned) (blockSeed + iteration);
+            if (programOptions.commonRandomNumbers) simulator->setTransmissionKey(transmissionKey(blockSeed, iteration));
+
+            auto record = [&](Simulator &lane, RunResult &result) {
+                measureRun(lane, result);
+                if (adaptiveMetric != metric_count) stopping.add(result.configurationKey(), result.metrics[adaptiveMetric]);
+                results.write(std::move(result));
+            };
+            vector<Strategy *> lockstepStrategies;
+            vector<RunResult> lockstepResults;
+
+            forEachStrategy(spec, runConfig, [&](Strategy *strategy) {
+                if (programOptions.dryRun) {
+                    cout << "Skipping because of dry run" << endl;
+                    delete strategy;
+                    return;
+                }
+                RunResult result = describeRun(runConfig);
+                if (adaptiveMetric != metric_count && stopping.converged(result.configurationKey())) {
+                    delete strategy;
+                    return;
+                }
+                if (programOptions.lockstep) {
+                    lockstepStrategies.push_back(strategy);
+                    lockstepResults.push_back(std::move(result));
+                    return;
+                }
+                performRun(*simulator, strategy, runConfig);
+                record(*simulator, result);
+            });
+
+            if (!lockstepStrategies.empty()) {
+                LockstepSimulator lockstep(*simulator);
+                lockstep.run(lockstepStrategies, simulator->getAttackerSetup());
+                for (size_t i = 0; i < lockstepResults.size(); i++) record(lockstep.lane(i), lockstepResults[i]);
             }
-            simulator.buildGraph();
         }
 
-        for (auto routerCount = programOptions.routerMin; routerCount <= programOptions.routerMax; routerCount += programOptions.routerStep) {
-            runConfig.routerCount = routerCount;
-
-            simulator.halfReset();
-            for (int i = 0; i < routerCount; i++) {
-                auto edge = simulator.random_weighted_edge();
-                simulator.addRouter(i, edge.first, edge.second, simulator.random_float(), radius);
-            }
+        // Checkpoint
+        if (!programOptions.dryRun) {
+            results.flush();
+            manifest.complete(job.id, filesystem::file_size(programOptions.outputFile, sizeError));
+        }
+    }
 
-            for (auto pTx = programOptions.pTxMin; pTx <= programOptions.pTxMax; pTx += programOptions.pTxStep) {
-                runConfig.att.tx_prob = pTx / 100.0;
-                int max_iteration_retries_ctr = max_iteration_retries;
-
-                for (int iteration = 0; iteration < programOptions.num_iterations; iteration++) {
-                    // Attacker parameters are fixed in this loop
-                    runConfig.att.alpha_router_index = simulator.random_int(simulator.countRouters() - 1);
-                    Router alphaRouter = simulator.getRouterByIndex(runConfig.att.alpha_router_index);
-                    runConfig.att.v1 = alphaRouter.edge.first;
-                    runConfig.att.v2 = alphaRouter.edge.second;
-                    runConfig.att.fraction = alphaRouter.fraction;
-                    runConfig.att.target = -1;
-
-                    // Find possible target
-                    for (int tries = 0; tries < 1024; tries++) {
-                        int target = simulator.random_int(map.nodes.size() - 1);
-                        if (simulator.setAttacker(runConfig.att.v1, runConfig.att.v2, target, runConfig.att.fraction,
-                                                  speed, runConfig.att.tx_prob,
-                                                  runConfig.att.alpha_router_index, min_distance)) {
-                            runConfig.att.target = target;
-                            break;
-                        }
-                    }
+    results.flush();
+    sink->finish();
 
-                    if (runConfig.att.target == -1) {
-                        cerr << "Could not find a valid attacker path. min_distance=" << min_distance << endl;
-                        cerr << "bounds=[" << map.bounds[0] << ", " << map.bounds[1] << ", " << map.bounds[2] << ", "
-                             << map.bounds[3] << "]" << endl;
-                        if (max_iteration_retries_ctr > 0) {
-                            max_iteration_retries_ctr--;
-                            iteration--;
-                        } else {
-                            min_distance = 0.99 * min_distance;
-                        }
-                        continue;
-                    }
+    reportProfile(programOptions);
+}
 
-#define performRun(strategy) {        \
-    if (programOptions.dryRun) cout << "Skipping because of dry run" << endl; \
-    else {                            \
-    simulator.reset();                \
-    simulator.setStrategy(strategy);  \
-    simulator.setAttacker(runConfig.att.v1, runConfig.att.v2, runConfig.att.target, runConfig.att.fraction, speed, runConfig.att.tx_prob, \
-                          runConfig.att.alpha_router_index, 0); \
-    runSimulator(simulator);          \
-    saveResult(simulator, runConfig, results);         \
-    }\
+uint64_t transmissionKey(int seed, int iteration) {
+    // Equal for all strategies of an iteration
+    return SweepManifest::hash(to_string(iteration), SweepManifest::hash(to_string(seed)));
 }
 
-                    // SER Strategy
-                    runConfig.strategy = SER;
-                    for (int range = programOptions.serRangeMin; range <= programOptions.serRangeMax; range += programOptions.serRangeStep) {
-                        float distance = range / 1000.0;
-                        runConfig.serParameters.distance = distance;
-                        performRun(new SlidingEuclideanRadiusStrategy(distance));
-                    }
+string sweepFingerprint(const ProgramOptions &programOptions, const SweepSpec &spec) {
+    // Everything that changes the results of a configuration or the partition of the sweep
+    ostringstream options;
+    options << spec.describe() << programOptions.contractionHierarchy << ";" << programOptions.commonRandomNumbers << ","
+            << programOptions.lockstep << ";"
+            << programOptions.outputFormat << ";" << programOptions.adaptiveMetric << "," << programOptions.ciWidth << ","
+            << programOptions.confidence << "," << programOptions.minIterations << ";"
+            << programOptions.shardIndex << "/" << programOptions.shardCount;
+    ostringstream fingerprint;
+    fingerprint << hex << SweepManifest::hash(options.str());
+    return fingerprint.str();
+}
+void reportProfile(const ProgramOptions &programOptions) {
+    if (programOptions.profile) profiler::report(cerr);
+    if (programOptions.traceFile.empty()) return;
+    if (!profiler::enabled()) {
+        // Without profiling there are no events, the report only tells how to build with it
+        if (!programOptions.profile) profiler::report(cerr);
+    } else if (!profiler::writeTrace(programOptions.traceFile)) {
+        cerr << "Could not write the trace to " << programOptions.traceFile << endl;
+    }
+}
 
-                    // SGR Strategy
-                    runConfig.strategy = SGR;
-                    for (int range = programOptions.sgrRangeMin; range <= programOptions.sgrRangeMax; range += programOptions.sgrRangeStep) {
-                        float distance = range / 1000.0;
-                        runConfig.sgrParameters.distance = distance;
-                        performRun(new SlidingGraphRadiusStrategy(distance));
-                    }
+namespace {
+    struct BenchCounters {
+        double seconds = 0; // Summed over the threads
+        int64_t runs = 0, ticks = 0;
+        long rssKb = 0; // Largest resident set of the process after a run
+    };
 
-                    // kSN Strategy
-                    runConfig.strategy = KSN;
-                    for (int k = programOptions.ksnKMin; k <= programOptions.ksnKMax; k += programOptions.ksnKStep) {
-                        runConfig.kSNParameters.k = k;
+    long residentSetKb() {
+        long pages = 0, resident = 0;
+        ifstream statm("/proc/self/statm");
+        if (!(statm >> pages >> resident)) return 0;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
 
-                        for (int dist = programOptions.ksnDistMin; dist <= programOptions.ksnDistMax; dist += programOptions.ksnDistStep) {
-                            runConfig.kSNParameters.maxDist = dist / 1000.0;
-                            performRun(new kSmartestNeighborsStrategy(k, (float) dist));
-                        }
-                    }
+    long peakResidentSetKb() {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss; // kB on Linux
+    }
 
-                    // Random Radius Strategy
-                    // todo
+    string jsonString(const string &value) {
+        string escaped = "\"";
+        for (char c: value) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
 
-                    // Random Streetdistance Strategy
-                    // todo
+    // Runs the whole sweep of the options on a fork of the scenario, which calculates the reach on its own thread
+    void benchSweep(const Simulator &scenario, const SweepSpec &spec, bool commonRandomNumbers, RunConfig runConfig,
+                    float minDistance, int seed, std::map<string, BenchCounters> &counters) {
+        Simulator simulator(scenario, seed);
+        for (int pTx: spec.pTxs) {
+            runConfig.att.tx_prob = pTx / 100.0;
+            for (int iteration = 0; iteration < spec.iterations; iteration++) {
+                float pathLength = minDistance;
+                bool found = selectAttacker(simulator, runConfig, pathLength);
+                for (int attempt = 0; !found && attempt < 100; attempt++) {
+                    pathLength *= 0.99;
+                    found = selectAttacker(simulator, runConfig, pathLength);
                 }
+                if (!found) continue;
+                runConfig.strategySeed = (unsigned) (seed + iteration);
+                if (commonRandomNumbers) simulator.setTransmissionKey(transmissionKey(seed, iteration));
+
+                forEachStrategy(spec, runConfig, [&](Strategy *strategy) {
+                    auto start = chrono::steady_clock::now();
+                    performRun(simulator, strategy, runConfig);
+                    auto &strategyCounters = counters[runConfig.strategy];
+                    strategyCounters.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                    strategyCounters.runs++;
+                    strategyCounters.ticks += simulator.getTick();
+                    strategyCounters.rssKb = max(strategyCounters.rssKb, residentSetKb());
+                });
             }
         }
     }
+}
+
+void runBench(const ProgramOptions &programOptions, const SweepSpec &spec) {
+    // Every thread runs the complete sweep with its own seed, so the work grows with the number of threads
+    unsigned hardwareThreads = max(1u, thread::hardware_concurrency());
+    unsigned scaledThreads = programOptions.benchThreads > 0 ? programOptions.benchThreads : hardwareThreads;
+    vector<unsigned> threadCounts = {1};
+    if (scaledThreads > 1) threadCounts.push_back(scaledThreads);
+
+    cout << "{\"seed\": " << spec.seed << ", \"hardware_threads\": " << hardwareThreads << ", \"results\": [";
+    bool first = true;
+    RunConfig runConfig;
+    for (const auto &mapFile: spec.maps) {
+        runConfig.map = mapFile.c_str();
+        ParsedOsm map;
+        {
+            PROFILE_SCOPE(phase_parse);
+            map = parseOsm(runConfig.map);
+        }
+        float minDistance = minPathLength(map);
+
+        Simulator scenario(spec.seed);
+        scenario.buildGraph(map.nodes, map.edges);
+        if (programOptions.contractionHierarchy) scenario.buildHierarchy(mapFile + ".ch");
 
-    results.close();
+        for (int routerCount: spec.routerCounts) {
+            runConfig.routerCount = routerCount;
+            scenario.halfReset();
+            scenario.sampleRouterLayout(routerCount, ROUTER_RADIUS);
+
+            for (auto threadCount: threadCounts) {
+                cerr << mapFile << " routers=" << routerCount << " threads=" << threadCount << endl;
+                vector<std::map<string, BenchCounters>> counters(threadCount);
+                vector<thread> threads;
+                auto start = chrono::steady_clock::now();
+                for (unsigned i = 0; i < threadCount; i++) {
+                    threads.emplace_back(benchSweep, std::cref(scenario), std::cref(spec), programOptions.commonRandomNumbers, runConfig, minDistance,
+                                         spec.seed + (int) i, std::ref(counters[i]));
+                }
+                for (auto &t: threads) t.join();
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                std::map<string, BenchCounters> total;
+                for (const auto &threadCounters: counters) {
+                    for (const auto &entry: threadCounters) {
+                        auto &strategyCounters = total[entry.first];
+                        strategyCounters.seconds += entry.second.seconds;
+                        strategyCounters.runs += entry.second.runs;
+                        strategyCounters.ticks += entry.second.ticks;
+                        strategyCounters.rssKb = max(strategyCounters.rssKb, entry.second.rssKb);
+                    }
+                }
+                int64_t runs = 0, ticks = 0;
+                for (const auto &entry: total) {
+                    runs += entry.second.runs;
+                    ticks += entry.second.ticks;
+                }
 
+                cout << (first ? "\n" : ",\n") << "  {\"map\": " << jsonString(mapFile) << ", \"routers\": " << routerCount
+                     << ", \"threads\": " << threadCount << ", \"seconds\": " << seconds << ", \"runs\": " << runs
+                     << ", \"ticks\": " << ticks << ", \"runs_per_second\": " << runs / seconds
+                     << ", \"ticks_per_second\": " << ticks / seconds << ", \"strategies\": {";
+                first = false;
+                bool firstStrategy = true;
+                for (const auto &entry: total) {
+                    // Per core: the time of a strategy is summed over the threads
+                    const auto &strategyCounters = entry.second;
+                    cout << (firstStrategy ? "" : ", ") << jsonString(entry.first) << ": {\"runs\": " << strategyCounters.runs
+                         << ", \"ticks\": " << strategyCounters.ticks << ", \"seconds\": " << strategyCounters.seconds
+                         << ", \"ticks_per_second\": " << strategyCounters.ticks / strategyCounters.seconds
+                         << ", \"rss_kb\": " << strategyCounters.rssKb << "}";
+                    firstStrategy = false;
+                }
+                cout << "}}";
+            }
+        }
+    }
+    cout << "\n], \"peak_rss_kb\": " << peakResidentSetKb() << "}" << endl;
 }
 
 ProgramOptions parseProgramOptions(int argc, char **argv) {
     ProgramOptions programOptions;
+    string shard;
 
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "produce help message")
         ("dry,d", po::value<bool>(&programOptions.dryRun)->default_value(false), "perform a dry run")
+        ("spec", po::value<string>(&programOptions.specFile),
+            "json file with the maps, router counts, pTx and strategy parameter grids of the sweep, replaces the "
+            "grid options below and covers all strategies, see SweepSpec.hpp")
         ("map,m", po::value<vector<string>>(&programOptions.maps), "osm map files")
         ("num-iterations,n", po::value<int>(&programOptions.num_iterations), "number of iterations for each configuration")
+        ("adaptive,a", po::value<string>(&programOptions.adaptiveMetric),
+            "stop the iterations of a configuration once the confidence interval of this metric is narrower than "
+            "--ci-width, --num-iterations is the cap: activity, detection, last_tracking, path_matching, "
+            "path_target_diff or path_length_diff")
+        ("ci-width", po::value<float>(&programOptions.ciWidth)->default_value(0.05), "width of the confidence interval of --adaptive")
+        ("confidence", po::value<float>(&programOptions.confidence)->default_value(0.95), "confidence level of --adaptive")
+        ("min-iterations", po::value<int>(&programOptions.minIterations)->default_value(5), "iterations before --adaptive may stop, at least 3")
         ("seed,s", po::value<int>(&programOptions.seed)->default_value(0), "seed")
-        ("output,o", po::value<string>(&programOptions.outputFile)->default_value("results.csv"), "file name of csv output");
+        ("common-random-numbers", po::bool_switch(&programOptions.commonRandomNumbers),
+            "let all strategies of an iteration see the same packets of the attacker, drawn per tick from a "
+            "counter-based generator, which reduces the variance of the differences between strategies")
+        ("lockstep", po::bool_switch(&programOptions.lockstep),
+            "run the strategies of an iteration side by side on one attacker trajectory, reach calculation and packet "
+            "sequence, instead of one after another")
+        ("contraction-hierarchy,c", po::value<bool>(&programOptions.contractionHierarchy)->default_value(false),
+            "preprocess the maps for fast shortest path queries, cached next to the map as <map>.ch")
+        ("profile,p", po::bool_switch(&programOptions.profile), "print the time spent per phase, needs a build with -DPROFILING=ON")
+        ("trace", po::value<string>(&programOptions.traceFile), "write the profiled phases as Chrome trace events to a json file")
+        ("output,o", po::value<string>(&programOptions.outputFile)->default_value("results.csv"), "file name of the results")
+        ("format,f", po::value<string>(&programOptions.outputFormat)->default_value("csv"),
+            "format of the results: csv, columnar for typed binary columns or summary for a csv row with the mean, "
+            "standard deviation and quantiles of the metrics per configuration, see ResultSink.hpp and Aggregation.hpp")
+        ("resume,r", po::bool_switch(&programOptions.resume),
+            "skip the configurations the manifest <output>.manifest of an interrupted sweep lists as done")
+        ("shard", po::value<string>(&shard)->default_value("0/1"),
+            "only run the i-th of n parts of the sweep, given as i/n, e.g. one per machine with their own output")
+        ("bench,b", po::bool_switch(&programOptions.bench),
+            "run the sweep once on one thread and once on every core, print the throughput as json instead of writing results")
+        ("bench-threads", po::value<int>(&programOptions.benchThreads)->default_value(0),
+            "threads of the scaled bench run, 0 for one per core");
 
     desc.add_options()
         ("router-min", po::value<int>(&programOptions.routerMin))
@@ -345,6 +620,13 @@ ProgramOptions parseProgramOptions(int argc, char **argv) {
 
     if (vm.count("help")) {
         cout << desc << endl;
+        exit(0);
+    }
+
+    if (sscanf(shard.c_str(), "%d/%d", &programOptions.shardIndex, &programOptions.shardCount) != 2 ||
+        programOptions.shardCount < 1 || programOptions.shardIndex < 0 || programOptions.shardIndex >= programOptions.shardCount) {
+        cerr << "Invalid shard " << shard << ", expected i/n with 0 <= i < n" << endl;
+        exit(1);
     }
     return programOptions;
 }
\ No newline at end of file
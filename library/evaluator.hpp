@@ -1,18 +1,31 @@
 #ifndef CHASE_SIMULATOR_EVALUATOR_HPP
 #define CHASE_SIMULATOR_EVALUATOR_HPP
 
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <cstring>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 
-#include "rapidxml/rapidxml.hpp"
-#include "rapidxml/rapidxml_utils.hpp"
+#include "LockstepSimulator.hpp"
+#include "OsmParser.hpp"
+#include "Profiler.hpp"
+#include "Aggregation.hpp"
+#include "ResultSink.hpp"
+#include "SweepManifest.hpp"
+#include "SweepSpec.hpp"
 #include "Simulator.hpp"
 
 using namespace std;
@@ -21,11 +34,6 @@ namespace po = boost::program_options;
 
 // Types
 
-struct way {
-    vector<long long> nodes;
-    char type[32] = {0};
-};
-
 struct attackerParameters {
     int v1, v2, target;
     float fraction;
@@ -68,6 +76,7 @@ typedef struct {
     int routerCount;
     struct attackerParameters att;
     const char *strategy;
+    unsigned strategySeed; // Of the random strategies
     union {
         struct staticParameters staticParameters;
         struct radiusParameters radiusParameters;
@@ -79,26 +88,37 @@ typedef struct {
     };
 } RunConfig;
 
-typedef struct parsedOsm {
-    float bounds[4];
-    vector<pair<float, float>> nodes;
-    vector<pair<int, int>> edges;
-} ParsedOsm;
-
 typedef struct programOptions {
     string outputFile;
+    string outputFormat;
+    string specFile;
     vector<string> maps;
-    int routerMin, routerMax, routerStep;
-    int pTxMin, pTxMax, pTxStep;
-    int serRangeMin, serRangeMax = -1, serRangeStep;
-    int sgrRangeMin, sgrRangeMax = -1, sgrRangeStep;
-    int ksnKMin, ksnKMax = -1, ksnKStep;
-    int ksnDistMin, ksnDistMax = -1, ksnDistStep;
-    int num_iterations;
+    // Ranges that are not given stay empty
+    int routerMin = 0, routerMax = -1, routerStep = 1;
+    int pTxMin = 0, pTxMax = -1, pTxStep = 1;
+    int serRangeMin = 0, serRangeMax = -1, serRangeStep = 1;
+    int sgrRangeMin = 0, sgrRangeMax = -1, sgrRangeStep = 1;
+    int ksnKMin = 0, ksnKMax = -1, ksnKStep = 1;
+    int ksnDistMin = 0, ksnDistMax = -1, ksnDistStep = 1;
+    int num_iterations = 1;
+    string adaptiveMetric;
+    float ciWidth, confidence;
+    int minIterations;
     int seed = 0;
+    bool commonRandomNumbers;
+    bool lockstep;
     bool dryRun;
+    bool contractionHierarchy;
+    bool profile;
+    string traceFile;
+    bool resume;
+    int shardIndex, shardCount;
+    bool bench;
+    int benchThreads;
 } ProgramOptions;
 
+typedef std::function<void(Strategy *strategy)> StrategyRun;
+
 // Constants
 
 const char *STATIC = "static";
@@ -109,11 +129,24 @@ const char *KSN = "ksn";
 const char *RANDOM_RADIUS = "random_radius";
 const char *RANDOM_STREETDISTANCE = "random_streetdistance";
 
+const float ROUTER_RADIUS = 0.02; // 20m
+const float ATTACKER_SPEED = 0.005; // 5m/s
+
 // Functions
 
-ParsedOsm parseOsm(const char *filename);
+float minPathLength(const ParsedOsm &map);
+bool selectAttacker(Simulator &simulator, RunConfig &runConfig, float minPathLength);
+bool loadSweepSpec(const ProgramOptions &programOptions, SweepSpec &spec, string &error);
+Strategy *createStrategy(const StrategyConfiguration &configuration, unsigned seed);
+void forEachStrategy(const SweepSpec &spec, RunConfig &runConfig, const StrategyRun &run);
+void performRun(Simulator &simulator, Strategy *strategy, const RunConfig &runConfig);
 void runSimulator(Simulator &simulator);
-void saveResult(Simulator &simulator, const RunConfig &runConfig);
+void runBench(const ProgramOptions &programOptions, const SweepSpec &spec);
+void reportProfile(const ProgramOptions &programOptions);
+uint64_t transmissionKey(int seed, int iteration);
+string sweepFingerprint(const ProgramOptions &programOptions, const SweepSpec &spec);
+RunResult describeRun(const RunConfig &runConfig);
+void measureRun(Simulator &simulator, RunResult &result);
 ProgramOptions parseProgramOptions(int argc, char **argv);
 
 #endif //CHASE_SIMULATOR_EVALUATOR_HPP